@@ -84,7 +84,8 @@ void setup(){
     int32_t q = millis();
   #endif
   
-  epd.drawGrayShades(img_buffer, img_width, img_height);
+  // ditherShades(img_buffer, img_width, img_height, 4);   // error diffusion down to 4 gray levels: smoother shading in 3 passes
+  epd.drawGrayShades(img_buffer, img_width, img_height);    // a 4th argument (max RMS error, e.g. 12) lets the library pick the thresholds and skip passes
   epd.WaitUntilIdle();
   epd.Sleep();
   
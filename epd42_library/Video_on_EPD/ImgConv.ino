@@ -1,20 +1,17 @@
 
-#define _mod_bitwise(x, mod)   (x & (mod - 1))
-
 void gray256To8bits(uint8_t *img, uint16_t img_width, uint16_t img_height,   // image width MUST be a multiple of 8.
                                       uint8_t *out_bf, uint8_t size_factor){
-  if((size_factor & (size_factor - 1)) != 0)  return;  // halt if size_factor is not a POWER of 2
-  uint8_t source, destination = 0;
-  uint16_t ind_byte = 0;
-  for(uint16_t row = 0; row < (img_height * size_factor); row++){
-    for(uint16_t col = 0; col < (img_width * size_factor); col++){
-      
-      if(!(col % 8)  &&  (col > 0  ||  row > 0)){
-        out_bf[ind_byte++] = destination;
-        destination = 0;
-      }
-      source = img[(col/size_factor) + (row/size_factor) * img_width];
-      destination |= ((source & 0x80) >> _mod_bitwise(col, 8));
+  static uint8_t packed[ep_width / 8];  // one source row, 8 pixels per byte
+  const uint16_t out_row_bytes = img_width * size_factor / 8;
+  Bitmap row = {packed, img_width, 1, 0};
+  for(uint16_t r = 0; r < img_height; r++){
+    const uint8_t *source = img + r * img_width;
+    for(uint16_t col = 0; col < img_width; col += 8){
+      uint8_t destination = 0;
+      for(uint8_t b = 0; b < 8; b++)  destination |= (source[col + b] & 0x80) >> b;
+      packed[col / 8] = destination;
     }
+    // every byte is expanded through a bit-doubling table, then the row is copied size_factor - 1 times
+    if(!UpscaleBits(row, out_bf + r * size_factor * out_row_bytes, size_factor))  return;  // halt if size_factor is not 1, 2, 4 or 8
   }
 }
@@ -7,6 +7,7 @@
 
 #include <SPI.h>
 #include <epd4in2.h>  // E-paper main library
+#include <epdpaint.h>  // 1bpp upscaler
 #include <Dither.h>
 
 #include <SD.h>
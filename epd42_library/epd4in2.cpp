@@ -29,6 +29,7 @@
 
 #include <stdlib.h>
 #include <epd4in2.h>
+#include "epdpaint.h"
 
 Epd::~Epd(){
 };
@@ -132,6 +133,14 @@ void Epd::Reset(void){
  *  @brief: transmit partial data to the SRAM.  The final parameter is either dtm=1 and dtm=2 (data transmission mode)
  */
 void Epd::SetPartialWindow(const unsigned char* buffer_black, int x, int y, int w, int l, int dtm){
+  SetPartialWindowRows(buffer_black, w / 8, x, y, w, l, dtm);
+}
+
+/**
+ *  @brief: same as SetPartialWindow, the rows of the window being stride bytes apart in frame_buffer
+ *          (e.g. a window cut out of a larger frame buffer: frame_buffer points to its first byte)
+ */
+void Epd::SetPartialWindowRows(const unsigned char* buffer_black, int stride, int x, int y, int w, int l, int dtm){
   SendCommand(PARTIAL_IN);
   SendCommand(PARTIAL_WINDOW);
   SendData(x >> 8);	//  Horizontal start, 8th bit : HRST[8]
@@ -145,8 +154,11 @@ void Epd::SetPartialWindow(const unsigned char* buffer_black, int x, int y, int
   SendData(0x01);         // Gates scan both inside and outside of the partial window (default)
   SendCommand((dtm == 1) ? DATA_START_TRANSMISSION_1 : DATA_START_TRANSMISSION_2);
   if (buffer_black != NULL){
-    for(uint16_t i = 0; i < ((w / 8) * l); i++){
-      SendData(buffer_black[i]);
+    for(int j = 0; j < l; j++){
+      for(int i = 0; i < w / 8; i++){
+        SendData(buffer_black[i]);
+      }
+      buffer_black += stride;
     }
   }
 	else{
@@ -157,6 +169,47 @@ void Epd::SetPartialWindow(const unsigned char* buffer_black, int x, int y, int
   SendCommand(PARTIAL_OUT);
 }
 
+/**
+ *  @brief: transmits only the dirty rectangles of a Paint (see Paint::GetDirtyRect), one partial
+ *          window each; it does not clear them. x, y: where the Paint buffer sits on the display
+ *          (x multiple of 8), 0, 0 for a full frame buffer. The rectangles are in frame rows:
+ *          on a banded Paint (see Paint::SetBand) they are read from the band rows they fall in.
+ */
+void Epd::SetPartialWindows(Paint& paint, int x, int y, int dtm){
+  int stride = paint.GetWidth() / 8;
+  int rx, ry, rw, rl;
+  for(int n = 0; n < paint.GetDirtyCount(); n++){
+    paint.GetDirtyRect(n, rx, ry, rw, rl);
+    SetPartialWindowRows(paint.GetImage() + (ry - paint.GetBandY()) * stride + rx / 8, stride, x + rx, y + ry, rw, rl, dtm);
+  }
+}
+
+
+/**
+ *  @brief: banded rendering, for boards without RAM for a whole frame buffer.
+ *          strip is a Paint as wide as the display and a few rows high (e.g. 400x16 = 800 bytes):
+ *          the frame is rendered one strip of rows at a time, draw being called for each strip
+ *          with the coordinates of the whole frame and the drawing clipped to the strip, which is
+ *          transmitted as soon as it is rendered. This does not refresh the display: call e.g.
+ *          DisplayFrame() or DisplayFrameQuick() afterwards. draw must clear the strip itself
+ *          (paint.Clear only clears the current strip) and draw the same frame at every call.
+ *          Nothing is done if the strip has no rows; on return the strip has its own height back
+ *          and no dirty rectangles.
+ */
+void Epd::DisplayBands(Paint& strip, BandCallback draw, int dtm){
+  int rows = strip.GetHeight();
+  int band;
+  if(rows <= 0)  return;    // an empty strip would never get through the frame
+  for(int y = 0; y < (int)height; y += rows){
+    band = (y + rows <= (int)height) ? rows : height - y;
+    strip.SetBand(y, band, height);
+    draw(strip);
+    SetPartialWindow(strip.GetImage(), 0, y, strip.GetWidth(), band, dtm);
+  }
+  strip.SetHeight(rows);
+  strip.ClearDirty();       // the strip dirty rectangles hold frame coordinates
+}
+
 
 /**
  * @brief: clear the frame data from both SRAMs, this won't refresh the display
@@ -380,10 +433,57 @@ void Epd::SetLutQuickAndHealthy(bool reset_cnt){
 						 the SetLutShades B2B formula and other LUT values)
 		@param: buffer_black: pointer to the image array (each pixel is an 8 bit value between 0-255)
 						w, l : the image dimensions. For best output, only use 400x300 images.
+						max_rms: 0 uses the fixed thresholds; otherwise the thresholds are picked from the
+						image histogram, with as few passes as the RMS error limit allows (see planShades)
+ */
+
+void Epd::drawGrayShades(const uint8_t* buffer_black, int w, int l, uint8_t max_rms){
+	ShadeImage image = {buffer_black, w, l, 8, NULL, 0};
+	drawGrayShades(image, max_rms);
+}
+
+/**
+ *  @brief: draws the image in gray shades, with the colored pixels of "overlay" forced to
+ 						overlay_gray (0 = black, 255 = white), in the same passes
+		@param: overlay: a Paint surface as large as the image (e.g. text drawn over the picture); it is
+ 						ignored if its buffer is not w x l pixels or holds only a band of rows
  */
 
-#define SHADES 8
-void Epd::drawGrayShades(const uint8_t* buffer_black, int w, int l){
+void Epd::drawGrayShades(const uint8_t* buffer_black, int w, int l, Paint& overlay, uint8_t overlay_gray, uint8_t max_rms){
+	const uint8_t* mask = overlay.GetImage();
+	if(overlay.GetWidth() != w || overlay.GetHeight() != l || overlay.GetBandRows() != l)  mask = NULL;	// would be read out of its buffer
+	ShadeImage image = {buffer_black, w, l, 8, mask, overlay_gray};
+	drawGrayShades(image, max_rms);
+}
+
+/**
+ *  @brief: draws the content of a 4 bit per pixel GrayPaint surface in gray shades;
+ 						nothing is drawn if the surface holds only a band of rows (see Paint::SetBand)
+ */
+
+void Epd::drawGrayShades(GrayPaint& paint, uint8_t max_rms){
+	if(paint.GetBandY() != 0 || paint.GetBandRows() != paint.GetHeight())  return;	// would be read out of its buffer
+	ShadeImage image = {paint.GetImage(), paint.GetWidth(), paint.GetHeight(), 4, NULL, 0};
+	drawGrayShades(image, max_rms);
+}
+
+/**
+ *  @brief: draws the content of an 8 bit per pixel BasicPaint surface (0 = black, 255 = white) in gray shades;
+ 						nothing is drawn if the surface holds only a band of rows (see Paint::SetBand)
+ */
+
+void Epd::drawGrayShades(BasicPaint<8>& paint, uint8_t max_rms){
+	if(paint.GetBandY() != 0 || paint.GetBandRows() != paint.GetHeight())  return;	// would be read out of its buffer
+	ShadeImage image = {paint.GetImage(), paint.GetWidth(), paint.GetHeight(), 8, NULL, 0};
+	drawGrayShades(image, max_rms);
+}
+
+/**
+ *  @brief: draws any image understood by the shade-plane generator (see epdshades.h)
+ */
+
+void Epd::drawGrayShades(const ShadeImage& image, uint8_t max_rms){
+	int w = image.width;
 	uint8_t m, n, old_m, old_n;
 	getCurrSpeedCoeff(m, n);
 	old_m = m;
@@ -393,11 +493,12 @@ void Epd::drawGrayShades(const uint8_t* buffer_black, int w, int l){
 	  Init(5, 1);		// the waveforms are based on this refresh rate!
 	}
 	
-	uint8_t* vect = (uint8_t*)malloc(8);
-	uint8_t cluster = 0;
-		
-	for(uint8_t shade = 0; shade < (SHADES - 1); shade++){
-		uint8_t thresh = 255 - (255*(shade+1))/SHADES;
+	ShadePlan plan;
+	planShades(image, plan, max_rms);
+	
+	for(uint8_t pass = 0; pass < plan.passes; pass++){
+		int y0 = plan.row_start[pass];
+		int y1 = plan.row_end[pass];
 		
 	  SendCommand(PARTIAL_IN);
 	  SendCommand(PARTIAL_WINDOW);
@@ -405,32 +506,18 @@ void Epd::drawGrayShades(const uint8_t* buffer_black, int w, int l){
 	  SendData(0);
 	  SendData((w  - 1) >> 8);
 	  SendData((w  - 1) | 0x07);
-	  SendData(0);
-	  SendData(0);
-	  SendData((l - 1) >> 8);
-	  SendData((l - 1) & 0xff);
+	  SendData(y0 >> 8);
+	  SendData(y0 & 0xff);
+	  SendData(y1 >> 8);
+	  SendData(y1 & 0xff);
 	  SendData(0x01);         // Gates scan both inside and outside of the partial window (default)
 	  SendCommand(DATA_START_TRANSMISSION_2);
-	  if (buffer_black != NULL){
-	    for(uint32_t i = 0; i < ((w / 8) * l); i++){
-	    	
-				for(uint8_t off = 0; off < 8; off++){
-					uint8_t value = (buffer_black[((i*8)+off)] < thresh)?  0x00 : 0xFF;
-					vect[off] = value;
-				}
-	    	
-	    	cluster = byteTo8Bits(vect);
-	      SendData(cluster);
-	    }
-	  }
-		else{
-	    for(uint16_t i = 0; i < ((w / 8) * l); i++){
-	      SendData(0x00);
-	    }
+	  for(uint32_t i = (uint32_t)y0 * (w / 8); i < (uint32_t)(y1 + 1) * (w / 8); i++){
+	    SendData(shadePlaneByte(image, i, plan.thresh[pass]));
 	  }
 	  
 	  SendCommand(PARTIAL_OUT);
-	  DisplayFrameShades(shade);
+	  DisplayFrameShades(plan.first_shade[pass], plan.last_shade[pass]);
 	  WaitUntilIdle();
 	}
 	
@@ -444,13 +531,38 @@ void Epd::drawGrayShades(const uint8_t* buffer_black, int w, int l){
  */
 
 void Epd::DisplayFrameShades(uint8_t grayshade_cnt){
-	SetLutShades(grayshade_cnt);
+	DisplayFrameShades(grayshade_cnt, grayshade_cnt);
+}
+
+/**
+ *  @brief: sends LUT for a gray shade update that stands for several identical iterations
+ * 	@param: first_shade, last_shade: the iterations covered by this refresh (see planShades)
+ */
+
+void Epd::DisplayFrameShades(uint8_t first_shade, uint8_t last_shade){
+	SetLutShades(first_shade, last_shade);
   SendCommand(DISPLAY_REFRESH);
 }
 
 
 void Epd::SetLutShades(uint8_t grayshade_cnt){
-  uint8_t b2b_formula = 2 + (15*grayshade_cnt)/(SHADES-1);
+	SetLutShades(grayshade_cnt, grayshade_cnt);
+}
+
+/**
+ *  @brief: the B2B drive of merged iterations is the sum of their drives; pixels turning black
+ 						in this refresh get the W2B drive of the first iteration, followed by the B2B
+						drive of the others (in the second phase of the W2B LUT).
+ */
+
+void Epd::SetLutShades(uint8_t first_shade, uint8_t last_shade){
+  uint8_t b2b_formula = 0;
+  uint8_t w2b_extra = 0;
+  for(uint8_t shade = first_shade; shade <= last_shade; shade++){
+  	uint8_t frames = 2 + (15*shade)/(SHADES-1);
+  	b2b_formula += frames;
+  	if(shade != first_shade)  w2b_extra += 2 * frames;		// both B2B phases
+  }
   
   unsigned int count;
   SendCommand(LUT_FOR_VCOM);                            //vcom
@@ -470,7 +582,7 @@ void Epd::SetLutShades(uint8_t grayshade_cnt){
 
   SendCommand(LUT_WHITE_TO_BLACK);                      //wb w
   for(count = 0; count < 42; count++){
-    SendData(lut_wb_shade[count]);
+    SendData((count == 2  &&  w2b_extra)?  w2b_extra : lut_wb_shade[count]);
   } 
 
   SendCommand(LUT_BLACK_TO_BLACK);                      //bb b
@@ -519,14 +631,6 @@ uint32_t Epd::index(int x, int y, int w){
 }
 
 
-uint8_t Epd::byteTo8Bits(uint8_t* source){
-	uint8_t output = 0;
-	output = (source[0] & 0x80) | ((source[1] >> 1) & 0x40) | ((source[2] >> 2) & 0x20) | ((source[3] >> 3) & 0x10) | 
-		((source[4] >> 4) & 0x08) | ((source[5] >> 5) & 0x04) | ((source[6] >> 6) & 0x02) | ((source[7] >> 7) & 0x01);
-	return output;
-}
-
-
 void Epd::getCurrSpeedCoeff(uint8_t& m, uint8_t& n){
 	m = _curr_M;
 	n = _curr_N;
@@ -38,6 +38,7 @@
 #define EPD4IN2_H
 
 #include "epdif.h"
+#include "epdshades.h"
 
 // Display resolution
 #define EPD_WIDTH       400
@@ -103,6 +104,13 @@ extern const unsigned char lut_wb_shade[];
 
 
 
+template<int Bpp> class BasicPaint;
+typedef BasicPaint<1> Paint;
+typedef BasicPaint<4> GrayPaint;
+
+// Draws a whole frame on paint (see Epd::DisplayBands)
+typedef void (*BandCallback)(Paint& paint);
+
 class Epd : EpdIf {
 public:
     unsigned int width;
@@ -116,6 +124,9 @@ public:
 		void Reset(void);
 		
 		void SetPartialWindow(const unsigned char* frame_buffer, int x, int y, int w, int l, int dtm = 2);
+		void SetPartialWindowRows(const unsigned char* frame_buffer, int stride, int x, int y, int w, int l, int dtm = 2);
+		void SetPartialWindows(Paint& paint, int x = 0, int y = 0, int dtm = 2);
+		void DisplayBands(Paint& strip, BandCallback draw, int dtm = 2);
 		void ClearFrame(void);
 		void DisplayFrame(const unsigned char* frame_buffer);
 		void DisplayFrame(void);
@@ -127,9 +138,17 @@ public:
 		void DisplayFrameQuickAndHealthy(bool reset_cnt = false);
 		void SetLutQuickAndHealthy(bool reset_cnt);
 		
-		void drawGrayShades(const uint8_t* buffer_black, int w, int l);
+		void drawGrayShades(const uint8_t* buffer_black, int w, int l, uint8_t max_rms = 0);
+		// overlay must be an unbanded Paint of w x l pixels, otherwise the image is drawn without it
+		void drawGrayShades(const uint8_t* buffer_black, int w, int l, Paint& overlay, uint8_t overlay_gray = 0, uint8_t max_rms = 0);
+		// paint must be unbanded, otherwise nothing is drawn
+		void drawGrayShades(GrayPaint& paint, uint8_t max_rms = 0);
+		void drawGrayShades(BasicPaint<8>& paint, uint8_t max_rms = 0);
+		void drawGrayShades(const ShadeImage& image, uint8_t max_rms = 0);
 		void DisplayFrameShades(uint8_t grayshade_cnt);
+		void DisplayFrameShades(uint8_t first_shade, uint8_t last_shade);
 		void SetLutShades(uint8_t grayshade_cnt);
+		void SetLutShades(uint8_t first_shade, uint8_t last_shade);
 		
 		
 		void SendCommand(unsigned char command);
@@ -151,8 +170,6 @@ private:
     unsigned int cs_pin;
     unsigned int busy_pin;
     
-    uint8_t byteTo8Bits(uint8_t* source);
-    
     void updateCurrSpeedCoeff(uint8_t m, uint8_t n);
     uint8_t _curr_M, _curr_N;
 };
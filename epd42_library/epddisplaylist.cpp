@@ -0,0 +1,388 @@
+/**
+ *  @filename   :   epddisplaylist.cpp
+ *  @brief      :   Retained display list with incremental redraw
+ *  @author     :   Deep Tronix
+ *
+ *  Copyright (C) Deep Tronix     2021
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documnetation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to  whom the Software is
+ * furished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS OR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "epddisplaylist.h"
+
+/* command types */
+#define COMMAND_TEXT            0
+#define COMMAND_LINE            1
+#define COMMAND_RECTANGLE       2
+#define COMMAND_FILLED_RECT     3
+#define COMMAND_CIRCLE          4
+#define COMMAND_FILLED_CIRCLE   5
+#define COMMAND_BLIT            6
+
+/* background of a transparent text command */
+#define NO_BACKGROUND           2
+
+/**
+ *  @brief: FNV-1a hash of size bytes, continued from hash
+ */
+static uint32_t HashBytes(uint32_t hash, const void* data, int size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (int n = 0; n < size; n++) {
+        hash = (hash ^ bytes[n]) * 16777619UL;
+    }
+    return hash;
+}
+
+static uint32_t HashInt(uint32_t hash, long value) {
+    return HashBytes(hash, &value, sizeof(value));
+}
+
+DisplayList::DisplayList(DisplayCommand* commands, int capacity, char* text, int text_size) {
+    this->commands = commands;
+    this->capacity = capacity;
+    this->text = text;
+    this->text_size = text_size;
+    this->count = 0;
+    this->last_count = 0;
+    this->text_used = 0;
+    this->background = 0;
+    this->last_background = 0;
+    this->overflow = false;
+    this->region_count = 0;
+    Invalidate();
+}
+
+DisplayList::~DisplayList() {
+}
+
+/**
+ *  @brief: the next End redraws everything (e.g. after drawing on the Paint directly)
+ */
+void DisplayList::Invalidate(void) {
+    this->valid = false;
+}
+
+/**
+ *  @brief: starts describing a frame, on a background of the given color
+ */
+void DisplayList::Begin(int background) {
+    this->background = background;
+    this->count = 0;
+    this->text_used = 0;
+    this->overflow = false;
+}
+
+/**
+ *  @brief: a new command, or NULL if the list is full
+ */
+DisplayCommand* DisplayList::Record(uint8_t type, int colored, int x0, int y0, int x1, int y1) {
+    DisplayCommand* command;
+    if (this->count >= this->capacity) {
+        this->overflow = true;
+        return NULL;
+    }
+    command = &commands[this->count];
+    command->type = type;
+    command->colored = colored ? 1 : 0;
+    command->background = NO_BACKGROUND;
+    command->rop = ROP_COPY;
+    command->x0 = x0;
+    command->y0 = y0;
+    command->x1 = x1;
+    command->y1 = y1;
+    command->radius = 0;
+    command->font = NULL;
+    command->text = -1;
+    command->bitmap.image = NULL;
+    command->src_x = 0;
+    command->src_y = 0;
+    return command;
+}
+
+/**
+ *  @brief: hashes the parameters of a command, stores its bounding box and commits it
+ */
+void DisplayList::Finish(DisplayCommand* command, int box_x0, int box_y0, int box_x1, int box_y1) {
+    uint32_t hash = 2166136261UL;
+    hash = HashInt(hash, command->type);
+    hash = HashInt(hash, command->colored);
+    hash = HashInt(hash, command->background);
+    hash = HashInt(hash, command->rop);
+    hash = HashInt(hash, command->x0);
+    hash = HashInt(hash, command->y0);
+    hash = HashInt(hash, command->x1);
+    hash = HashInt(hash, command->y1);
+    hash = HashInt(hash, command->radius);
+    hash = HashBytes(hash, &command->font, sizeof(command->font));
+    if (command->text >= 0) {
+        hash = HashBytes(hash, &this->text[command->text], strlen(&this->text[command->text]));
+    }
+    if (command->bitmap.image != NULL) {
+        hash = HashBytes(hash, &command->bitmap.image, sizeof(command->bitmap.image));
+        hash = HashInt(hash, command->bitmap.width);
+        hash = HashInt(hash, command->bitmap.height);
+        hash = HashInt(hash, command->src_x);
+        hash = HashInt(hash, command->src_y);
+        /* the content of a RAM bitmap may change under the same pointer; PROGMEM ones cannot */
+        if (!command->bitmap.progmem) {
+            hash = HashBytes(hash, command->bitmap.image,
+                             ((command->bitmap.width + 7) / 8) * command->bitmap.height);
+        }
+    }
+    command->hash = hash;
+    command->box[0] = box_x0;
+    command->box[1] = box_y0;
+    command->box[2] = box_x1;
+    command->box[3] = box_y1;
+    this->count++;
+}
+
+void DisplayList::DrawStringAt(int x, int y, const char* text, sFONT* font, int colored) {
+    int length = strlen(text);
+    DisplayCommand* command = Record(COMMAND_TEXT, colored, x, y, x, y);
+    if (command == NULL) {
+        return;
+    }
+    if (this->text_used + length + 1 > this->text_size) {
+        this->overflow = true;
+        return;
+    }
+    memcpy(&this->text[this->text_used], text, length + 1);
+    command->text = this->text_used;
+    command->font = font;
+    this->text_used += length + 1;
+    /* a cell per character, not per byte */
+    Finish(command, x, y, x + CountUtf8(text) * font->Width - 1, y + font->Height - 1);
+}
+
+void DisplayList::DrawStringAt(int x, int y, const char* text, sFONT* font, int colored, int background) {
+    int index = this->count;
+    DrawStringAt(x, y, text, font, colored);
+    if (this->count > index) {
+        /* recorded: hash it again with its background */
+        this->count--;
+        commands[index].background = background ? 1 : 0;
+        Finish(&commands[index], commands[index].box[0], commands[index].box[1],
+               commands[index].box[2], commands[index].box[3]);
+    }
+}
+
+void DisplayList::DrawLine(int x0, int y0, int x1, int y1, int colored) {
+    DisplayCommand* command = Record(COMMAND_LINE, colored, x0, y0, x1, y1);
+    if (command != NULL) {
+        Finish(command, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0);
+    }
+}
+
+void DisplayList::DrawRectangle(int x0, int y0, int x1, int y1, int colored) {
+    DisplayCommand* command = Record(COMMAND_RECTANGLE, colored, x0, y0, x1, y1);
+    if (command != NULL) {
+        Finish(command, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0);
+    }
+}
+
+void DisplayList::DrawFilledRectangle(int x0, int y0, int x1, int y1, int colored) {
+    DisplayCommand* command = Record(COMMAND_FILLED_RECT, colored, x0, y0, x1, y1);
+    if (command != NULL) {
+        Finish(command, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0);
+    }
+}
+
+void DisplayList::DrawCircle(int x, int y, int radius, int colored) {
+    DisplayCommand* command = Record(COMMAND_CIRCLE, colored, x, y, x, y);
+    if (command != NULL) {
+        command->radius = radius;
+        Finish(command, x - radius, y - radius, x + radius, y + radius);
+    }
+}
+
+void DisplayList::DrawFilledCircle(int x, int y, int radius, int colored) {
+    DisplayCommand* command = Record(COMMAND_FILLED_CIRCLE, colored, x, y, x, y);
+    if (command != NULL) {
+        command->radius = radius;
+        Finish(command, x - radius, y - radius, x + radius, y + radius);
+    }
+}
+
+void DisplayList::Blit(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y, int rop) {
+    DisplayCommand* command = Record(COMMAND_BLIT, 1, x, y, width, height);
+    if (command != NULL) {
+        command->bitmap = src;
+        command->src_x = src_x;
+        command->src_y = src_y;
+        command->rop = rop;
+        Finish(command, x, y, x + width - 1, y + height - 1);
+    }
+}
+
+/**
+ *  @brief: adds a changed area; overlapping areas are merged, and when there are too many
+ *          the new one joins the area it grows the least
+ */
+void DisplayList::AddRegion(const int* box) {
+    int merged[4];
+    int n, best;
+    long growth, best_growth;
+
+    if (box[0] > box[2] || box[1] > box[3]) {
+        return;
+    }
+    memcpy(merged, box, sizeof(merged));
+    for (n = 0; n < this->region_count; n++) {
+        int* region = regions[n];
+        if (region[0] <= merged[2] && merged[0] <= region[2] &&
+            region[1] <= merged[3] && merged[1] <= region[3]) {
+            merged[0] = region[0] < merged[0] ? region[0] : merged[0];
+            merged[1] = region[1] < merged[1] ? region[1] : merged[1];
+            merged[2] = region[2] > merged[2] ? region[2] : merged[2];
+            merged[3] = region[3] > merged[3] ? region[3] : merged[3];
+            memcpy(regions[n], regions[--this->region_count], sizeof(regions[n]));
+            n = -1;
+        }
+    }
+    if (this->region_count < DISPLAY_LIST_REGIONS) {
+        memcpy(regions[this->region_count++], merged, sizeof(merged));
+        return;
+    }
+    best = 0;
+    best_growth = -1;
+    for (n = 0; n < DISPLAY_LIST_REGIONS; n++) {
+        int* region = regions[n];
+        growth = (long)((region[2] > merged[2] ? region[2] : merged[2]) - (region[0] < merged[0] ? region[0] : merged[0]) + 1) *
+                 ((region[3] > merged[3] ? region[3] : merged[3]) - (region[1] < merged[1] ? region[1] : merged[1]) + 1) -
+                 (long)(region[2] - region[0] + 1) * (region[3] - region[1] + 1);
+        if (best_growth < 0 || growth < best_growth) {
+            best_growth = growth;
+            best = n;
+        }
+    }
+    /* the grown area may now overlap others: add it again */
+    merged[0] = regions[best][0] < merged[0] ? regions[best][0] : merged[0];
+    merged[1] = regions[best][1] < merged[1] ? regions[best][1] : merged[1];
+    merged[2] = regions[best][2] > merged[2] ? regions[best][2] : merged[2];
+    merged[3] = regions[best][3] > merged[3] ? regions[best][3] : merged[3];
+    memcpy(regions[best], regions[--this->region_count], sizeof(regions[best]));
+    AddRegion(merged);
+}
+
+void DisplayList::Replay(Paint& paint, const DisplayCommand& command) {
+    switch (command.type) {
+    case COMMAND_TEXT:
+        if (command.background == NO_BACKGROUND) {
+            paint.DrawStringAt(command.x0, command.y0, &this->text[command.text], command.font, command.colored);
+        } else {
+            paint.DrawStringAt(command.x0, command.y0, &this->text[command.text], command.font,
+                               command.colored, command.background);
+        }
+        break;
+    case COMMAND_LINE:
+        paint.DrawLine(command.x0, command.y0, command.x1, command.y1, command.colored);
+        break;
+    case COMMAND_RECTANGLE:
+        paint.DrawRectangle(command.x0, command.y0, command.x1, command.y1, command.colored);
+        break;
+    case COMMAND_FILLED_RECT:
+        paint.DrawFilledRectangle(command.x0, command.y0, command.x1, command.y1, command.colored);
+        break;
+    case COMMAND_CIRCLE:
+        paint.DrawCircle(command.x0, command.y0, command.radius, command.colored);
+        break;
+    case COMMAND_FILLED_CIRCLE:
+        paint.DrawFilledCircle(command.x0, command.y0, command.radius, command.colored);
+        break;
+    case COMMAND_BLIT:
+        paint.Blit(command.bitmap, command.src_x, command.src_y, command.x1, command.y1,
+                   command.x0, command.y0, command.rop);
+        break;
+    }
+}
+
+/**
+ *  @brief: ends the frame and brings the Paint up to date with it. Only the areas of the
+ *          commands that differ from the previous frame (their old and new bounding boxes)
+ *          are cleared and redrawn, clipped (see Paint::PushClip), with every command
+ *          overlapping them; the first frame, or a change of background, redraws everything.
+ *          returns the number of areas redrawn (1 for everything), -1 if commands were
+ *          dropped for lack of room (the next frame is then redrawn whole).
+ */
+int DisplayList::End(Paint& paint) {
+    int n, r, regions_drawn = 1;
+    bool full = !this->valid || this->background != this->last_background;
+    const unsigned char* pattern = paint.GetFillPattern();
+    unsigned char saved_pattern[8];
+
+    /* plain fills, so that a redrawn area matches a full redraw */
+    if (pattern != NULL) {
+        memcpy(saved_pattern, pattern, sizeof(saved_pattern));
+        paint.SetFillPattern(NULL);
+    }
+    this->region_count = 0;
+    if (!full) {
+        for (n = 0; n < this->count || n < this->last_count; n++) {
+            if (n >= this->count) {
+                AddRegion(commands[n].last_box);
+            } else if (n >= this->last_count) {
+                AddRegion(commands[n].box);
+            } else if (commands[n].hash != commands[n].last_hash) {
+                AddRegion(commands[n].last_box);
+                AddRegion(commands[n].box);
+            }
+        }
+        regions_drawn = this->region_count;
+        for (r = 0; r < this->region_count; r++) {
+            int* region = regions[r];
+            if (!paint.PushClip(region[0], region[1], region[2], region[3])) {
+                /* the caller used up the clip stack */
+                full = true;
+                break;
+            }
+            paint.DrawFilledRectangle(region[0], region[1], region[2], region[3], this->background);
+            for (n = 0; n < this->count; n++) {
+                const int* box = commands[n].box;
+                if (box[0] <= region[2] && region[0] <= box[2] && box[1] <= region[3] && region[1] <= box[3]) {
+                    Replay(paint, commands[n]);
+                }
+            }
+            paint.PopClip();
+        }
+    }
+    if (full) {
+        paint.Clear(this->background);
+        for (n = 0; n < this->count; n++) {
+            Replay(paint, commands[n]);
+        }
+        regions_drawn = 1;
+    }
+    if (pattern != NULL) {
+        paint.SetFillPattern(saved_pattern);
+    }
+
+    for (n = 0; n < this->count; n++) {
+        commands[n].last_hash = commands[n].hash;
+        memcpy(commands[n].last_box, commands[n].box, sizeof(commands[n].box));
+    }
+    this->last_count = this->count;
+    this->last_background = this->background;
+    this->valid = !this->overflow;
+    return this->overflow ? -1 : regions_drawn;
+}
+
+/* END OF FILE */
@@ -0,0 +1,110 @@
+/**
+ *  @filename   :   epddisplaylist.h
+ *  @brief      :   Header file for epddisplaylist.cpp
+ *  @author     :   Deep Tronix
+ *
+ *  Copyright (C) Deep Tronix     2021
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documnetation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to  whom the Software is
+ * furished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS OR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef EPDDISPLAYLIST_H
+#define EPDDISPLAYLIST_H
+
+#include <stdint.h>
+#include "epdpaint.h"
+
+// Changed areas a DisplayList redraws separately; more are merged together
+#define DISPLAY_LIST_REGIONS    8
+
+/**
+ *  One recorded command of a DisplayList, with its hash and bounding box (logical coordinates)
+ *  in the current and in the previous frame.
+ */
+struct DisplayCommand {
+    uint8_t type;
+    uint8_t colored;
+    uint8_t background;
+    uint8_t rop;
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+    int radius;
+    sFONT* font;
+    int text;
+    Bitmap bitmap;
+    int src_x;
+    int src_y;
+    uint32_t hash;
+    int box[4];
+    uint32_t last_hash;
+    int last_box[4];
+};
+
+/**
+ *  Retained display list: the screen is described again at every frame, between Begin and
+ *  End, and End only redraws on the Paint the areas where a command changed (moved, different
+ *  text, different color...), replaying there every command that overlaps them. The Paint dirty
+ *  rectangles then hold those areas, ready for Epd::SetPartialWindows.
+ *  Commands are matched by their order, as a layout redrawn every second keeps it.
+ *  The memory is given by the caller: room for capacity commands, and text_size bytes for
+ *  the strings of a frame (they are copied, the caller may reuse its buffers).
+ *  Fill patterns of the Paint are ignored: End draws with plain fills, as Paint::Clear does.
+ */
+class DisplayList {
+public:
+    DisplayList(DisplayCommand* commands, int capacity, char* text, int text_size);
+    ~DisplayList();
+    void Begin(int background);
+    void DrawStringAt(int x, int y, const char* text, sFONT* font, int colored);
+    void DrawStringAt(int x, int y, const char* text, sFONT* font, int colored, int background);
+    void DrawLine(int x0, int y0, int x1, int y1, int colored);
+    void DrawRectangle(int x0, int y0, int x1, int y1, int colored);
+    void DrawFilledRectangle(int x0, int y0, int x1, int y1, int colored);
+    void DrawCircle(int x, int y, int radius, int colored);
+    void DrawFilledCircle(int x, int y, int radius, int colored);
+    void Blit(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y, int rop = ROP_COPY);
+    int  End(Paint& paint);
+    void Invalidate(void);
+
+private:
+    DisplayCommand* Record(uint8_t type, int colored, int x0, int y0, int x1, int y1);
+    void Finish(DisplayCommand* command, int box_x0, int box_y0, int box_x1, int box_y1);
+    void AddRegion(const int* box);
+    void Replay(Paint& paint, const DisplayCommand& command);
+
+    DisplayCommand* commands;
+    int capacity;
+    int count;
+    int last_count;
+    char* text;
+    int text_size;
+    int text_used;
+    int background;
+    int last_background;
+    bool valid;
+    bool overflow;
+    int regions[DISPLAY_LIST_REGIONS][4];
+    int region_count;
+};
+
+#endif
+
+/* END OF FILE */
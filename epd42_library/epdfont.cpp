@@ -0,0 +1,198 @@
+/**
+ *  @filename   :   epdfont.cpp
+ *  @brief      :   Proportional fonts: glyph lookup and bitmap decoding
+ *  @author     :   Deep Tronix
+ *
+ *  Copyright (C) Deep Tronix     2021
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documnetation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to  whom the Software is
+ * furished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS OR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef AVR_ARCH
+#include <avr/pgmspace.h>
+#else
+#include <pgmspace.h>
+#endif
+#include <string.h>
+#include "epdfont.h"
+
+GlyphReader::GlyphReader(const sPFONT* font, const sGlyph& glyph) {
+    this->data = font->bitmaps + glyph.offset;
+    this->width = glyph.width;
+    this->rle = font->rle != 0;
+    this->position = 0;
+    this->run = 0;
+    this->run_value = 0;
+    this->toggle = false;
+}
+
+/**
+ *  @brief: decodes the next row of the glyph into row ((width + 7) / 8 bytes).
+ *          Raw rows are realigned a byte at a time, runs are set a byte at a time.
+ */
+void GlyphReader::ReadRow(unsigned char* row) {
+    int row_bytes = (this->width + 7) / 8;
+    if (!this->rle) {
+        const uint8_t* src = this->data + (this->position >> 3);
+        int shift = this->position & 7;
+        int last_bits = this->width - (row_bytes - 1) * 8;
+        for (int n = 0; n < row_bytes; n++) {
+            unsigned char value = pgm_read_byte(src + n) << shift;
+            /* the second byte only if the pixels reach it */
+            if (shift && (n < row_bytes - 1 || last_bits > 8 - shift)) {
+                value |= pgm_read_byte(src + n + 1) >> (8 - shift);
+            }
+            row[n] = value;
+        }
+        if (last_bits < 8) {
+            row[row_bytes - 1] &= 0xFF << (8 - last_bits);
+        }
+        this->position += this->width;
+        return;
+    }
+    memset(row, 0, row_bytes);
+    for (int x = 0; x < this->width; ) {
+        while (this->run == 0) {
+            /* runs alternate, but a run of 15 goes on in the next nibble */
+            if (this->toggle) {
+                this->run_value ^= 1;
+            }
+            unsigned char code = pgm_read_byte(this->data + (this->position >> 1));
+            this->run = (this->position & 1) ? code & 0x0F : code >> 4;
+            this->toggle = this->run != 15;
+            this->position++;
+        }
+        int count = this->run < this->width - x ? this->run : this->width - x;
+        this->run -= count;
+        if (this->run_value) {
+            /* pixels x ... x + count - 1: partial bytes masked, whole ones set */
+            int last = x + count - 1;
+            unsigned char head = 0xFF >> (x & 7);
+            unsigned char tail = 0xFF << (7 - (last & 7));
+            if (x / 8 == last / 8) {
+                row[x / 8] |= head & tail;
+            } else {
+                row[x / 8] |= head;
+                memset(row + x / 8 + 1, 0xFF, last / 8 - x / 8 - 1);
+                row[last / 8] |= tail;
+            }
+        }
+        x += count;
+    }
+}
+
+/**
+ *  @brief: reads the glyph of the code point code into glyph, found by a binary search of
+ *          the ranges of the font. returns 0 if the font does not have it.
+ */
+int FindGlyph(const sPFONT* font, uint16_t code, sGlyph& glyph) {
+    int low = 0, high = font->range_count - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const sGlyphRange* range = font->ranges + middle;
+        if (code < pgm_read_word(&range->first)) {
+            high = middle - 1;
+        } else if (code > pgm_read_word(&range->last)) {
+            low = middle + 1;
+        } else {
+            const sGlyph* entry = font->glyphs + pgm_read_word(&range->glyph) + (code - pgm_read_word(&range->first));
+            glyph.offset = pgm_read_word(&entry->offset);
+            glyph.width = pgm_read_byte(&entry->width);
+            glyph.height = pgm_read_byte(&entry->height);
+            glyph.advance = pgm_read_byte(&entry->advance);
+            glyph.x_offset = (int8_t)pgm_read_byte(&entry->x_offset);
+            glyph.y_offset = pgm_read_byte(&entry->y_offset);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  @brief: decodes the UTF-8 character at text and moves text past it. Invalid or truncated
+ *          sequences, and characters past U+FFFF, give U+FFFD (replacement character),
+ *          one byte consumed for an invalid one.
+ */
+uint16_t DecodeUtf8(const char*& text) {
+    const unsigned char* bytes = (const unsigned char*)text;
+    unsigned long code;
+    int length;
+
+    if (bytes[0] < 0x80) {
+        text++;
+        return bytes[0];
+    } else if ((bytes[0] & 0xE0) == 0xC0) {
+        code = bytes[0] & 0x1F;
+        length = 2;
+    } else if ((bytes[0] & 0xF0) == 0xE0) {
+        code = bytes[0] & 0x0F;
+        length = 3;
+    } else if ((bytes[0] & 0xF8) == 0xF0) {
+        code = bytes[0] & 0x07;
+        length = 4;
+    } else {
+        text++;
+        return 0xFFFD;
+    }
+    for (int n = 1; n < length; n++) {
+        /* a continuation byte is 10xxxxxx; the terminating 0 stops here too */
+        if ((bytes[n] & 0xC0) != 0x80) {
+            text++;
+            return 0xFFFD;
+        }
+        code = (code << 6) | (bytes[n] & 0x3F);
+    }
+    text += length;
+    /* overlong forms, surrogates and the planes past the first are not drawn */
+    if ((length == 2 && code < 0x80) || (length == 3 && code < 0x800) || (length == 4 && code < 0x10000) ||
+        (code >= 0xD800 && code <= 0xDFFF) || code > 0xFFFF) {
+        return 0xFFFD;
+    }
+    return (uint16_t)code;
+}
+
+/**
+ *  @brief: number of characters of the UTF-8 text, as DecodeUtf8 reads them
+ */
+int CountUtf8(const char* text) {
+    int count = 0;
+    const char* p_text = text;
+    while (*p_text != 0) {
+        DecodeUtf8(p_text);
+        count++;
+    }
+    return count;
+}
+
+/**
+ *  @brief: width in pixels of the UTF-8 text drawn with font (the sum of the advances)
+ */
+int GetTextWidth(const sPFONT* font, const char* text) {
+    sGlyph glyph;
+    int width = 0;
+    const char* p_text = text;
+    while (*p_text != 0) {
+        if (FindGlyph(font, DecodeUtf8(p_text), glyph)) {
+            width += glyph.advance;
+        }
+    }
+    return width;
+}
+
+/* END OF FILE */
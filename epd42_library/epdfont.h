@@ -0,0 +1,103 @@
+/**
+ *  @filename   :   epdfont.h
+ *  @brief      :   Header file for epdfont.cpp
+ *  @author     :   Deep Tronix
+ *
+ *  Copyright (C) Deep Tronix     2021
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documnetation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to  whom the Software is
+ * furished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS OR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef EPDFONT_H
+#define EPDFONT_H
+
+#include <stdint.h>
+
+/**
+ *  One glyph of a proportional font. Its bitmap, width x height pixels, starts at byte offset
+ *  of the font bitmaps and is drawn x_offset pixels right of the pen and y_offset pixels below
+ *  the top of the line; the pen then moves advance pixels right.
+ *  Raw bitmaps are the pixels in row order, 8 per byte (leftmost in the most significant bit),
+ *  without padding between rows. Run-length encoded bitmaps are the lengths of the runs of
+ *  the same pixels in row order, a nibble each (high nibble first): the runs alternate, from
+ *  a run of 0 pixels, except after a length of 15, which the next nibble continues.
+ */
+typedef struct {
+    uint16_t offset;
+    uint8_t width;
+    uint8_t height;
+    uint8_t advance;
+    int8_t x_offset;
+    uint8_t y_offset;
+} sGlyph;
+
+/**
+ *  Code points first ... last of a font, whose glyphs are glyph, glyph + 1...
+ */
+typedef struct {
+    uint16_t first;
+    uint16_t last;
+    uint16_t glyph;
+} sGlyphRange;
+
+/**
+ *  Proportional font: its glyphs, their bitmaps and the ranges of code points they are for
+ *  (ascending, not overlapping), in PROGMEM, as written by extras/font_converter; only the
+ *  characters included take room. height is the line height.
+ */
+typedef struct {
+    const uint8_t* bitmaps;
+    const sGlyph* glyphs;
+    const sGlyphRange* ranges;
+    uint16_t range_count;
+    uint8_t height;
+    uint8_t rle;
+} sPFONT;
+
+#ifdef __cplusplus
+
+/**
+ *  Decodes the bitmap of a glyph row by row, raw or run-length encoded, in the layout of a
+ *  Bitmap row: (width + 7) / 8 bytes, leftmost pixel in the most significant bit.
+ */
+class GlyphReader {
+public:
+    GlyphReader(const sPFONT* font, const sGlyph& glyph);
+    void ReadRow(unsigned char* row);
+
+private:
+    const uint8_t* data;
+    int width;
+    bool rle;
+    unsigned long position;
+    int run;
+    int run_value;
+    bool toggle;
+};
+
+int  FindGlyph(const sPFONT* font, uint16_t code, sGlyph& glyph);
+uint16_t DecodeUtf8(const char*& text);
+int  CountUtf8(const char* text);
+int GetTextWidth(const sPFONT* font, const char* text);
+
+#endif
+
+#endif
+
+/* END OF FILE */
@@ -30,318 +30,2777 @@
 #include <pgmspace.h>
 #endif
 
+#include <string.h>
 #include "epdpaint.h"
 
-Paint::Paint(unsigned char* image, int width, int height) {
-    this->rotate = ROTATE_0;
+/* frame buffer bit value of a colored / uncolored pixel (1 bpp) */
+#define INK(colored)        (IF_INVERT_COLOR ? ((colored) != 0) : ((colored) == 0))
+
+/* the frame buffer is ROTATE_90 and ROTATE_270 logical columns */
+#define IS_PORTRAIT(rotate) ((rotate) == ROTATE_90 || (rotate) == ROTATE_270)
+
+/* a byte of a bitmap, from PROGMEM if PGM */
+#define READ_BYTE(PGM, ptr) ((PGM) ? pgm_read_byte(ptr) : *(ptr))
+
+/* pixel value of the routines drawing the fill pattern (see SetFillPattern), after 0 and 1 */
+#define PATTERN             2
+
+/* raster operation of proportional glyphs, after those of Blit: set bits take the ink (see Ink) */
+#define ROP_INK             6
+
+/* bytes of the buffer proportional glyphs are decoded into, a few rows at a time */
+#define PFONT_BUFFER_BYTES  128
+
+/* widest font row blitted as whole bytes (64 pixels); wider fonts are drawn bit by bit */
+#define GLYPH_ROW_BYTES     8
+
+template<int Bpp>
+BasicPaint<Bpp>::BasicPaint(unsigned char* image, int width, int height) {
     this->image = image;
-    /* 1 byte = 8 pixels, so the width should be the multiple of 8 */
+    /* rows are whole bytes (8 pixels at 1 bpp) and dirty rectangles 8 pixels wide, so the width should be the multiple of 8 */
     this->width = width % 8 ? width + 8 - (width % 8) : width;
     this->height = height;
+    this->band_y = 0;
+    this->band_rows = height;
+    this->glyph_cache = NULL;
+    this->dirty_count = 0;
+    this->dirty_slack = DIRTY_MERGE_SLACK;
+    this->clip_depth = 0;
+    this->fill_patterned = false;
+    this->ink_value = 0;
+    this->ink_byte = 0x00;
+    this->paper_byte = 0x00;
+    SetRotate(ROTATE_0);
 }
 
-Paint::~Paint() {
+template<int Bpp>
+BasicPaint<Bpp>::~BasicPaint() {
 }
 
 /**
  *  @brief: clear the image
  */
-void Paint::Clear(int colored) {
-    for (int x = 0; x < this->width; x++) {
-        for (int y = 0; y < this->height; y++) {
-            DrawAbsolutePixel(x, y, colored);
-        }
-    }
+template<int Bpp>
+void BasicPaint<Bpp>::Clear(int colored) {
+    Ink(colored);
+    memset(this->image, this->ink_byte, RowBytes() * this->band_rows);
+    MarkAbsoluteDirty(0, this->band_y, this->width - 1, this->band_y + this->band_rows - 1);
 }
 
 /**
  *  @brief: this draws a pixel by absolute coordinates.
  *          this function won't be affected by the rotate parameter.
  */
-void Paint::DrawAbsolutePixel(int x, int y, int colored) {
-    if (x < 0 || x >= this->width || y < 0 || y >= this->height) {
+template<int Bpp>
+void BasicPaint<Bpp>::DrawAbsolutePixel(int x, int y, int colored) {
+    if (x < 0 || x >= this->width || y < this->band_y || y >= this->band_y + this->band_rows) {
         return;
     }
-    if (IF_INVERT_COLOR) {
-        if (colored) {
-            image[(x + y * this->width) / 8] |= 0x80 >> (x % 8);
-        } else {
-            image[(x + y * this->width) / 8] &= ~(0x80 >> (x % 8));
-        }
+    MarkAbsoluteDirty(x, y, x, y);
+    if (Ink(colored)) {
+        PlotAbsolute<1>(x, y);
     } else {
-        if (colored) {
-            image[(x + y * this->width) / 8] &= ~(0x80 >> (x % 8));
-        } else {
-            image[(x + y * this->width) / 8] |= 0x80 >> (x % 8);
-        }
+        PlotAbsolute<0>(x, y);
+    }
+}
+
+/**
+ *  @brief: the value of an absolute pixel (the frame buffer bit at 1 bpp), -1 outside
+ *          the band held by the frame buffer
+ */
+template<int Bpp>
+int BasicPaint<Bpp>::GetAbsolutePixel(int x, int y) {
+    if (x < 0 || x >= this->width || y < this->band_y || y >= this->band_y + this->band_rows) {
+        return -1;
     }
+    return (AbsoluteRow(y)[x >> PIXEL_SHIFT] >> ((PIXELS_PER_BYTE - 1 - (x & (PIXELS_PER_BYTE - 1))) * Bpp)) & PIXEL_MASK;
 }
 
 /**
  *  @brief: Getters and Setters
  */
-unsigned char* Paint::GetImage(void) {
+template<int Bpp>
+unsigned char* BasicPaint<Bpp>::GetImage(void) {
     return this->image;
 }
 
-int Paint::GetWidth(void) {
+template<int Bpp>
+int BasicPaint<Bpp>::GetWidth(void) {
     return this->width;
 }
 
-void Paint::SetWidth(int width) {
+template<int Bpp>
+void BasicPaint<Bpp>::SetWidth(int width) {
     this->width = width % 8 ? width + 8 - (width % 8) : width;
+    ResetClip();
 }
 
-int Paint::GetHeight(void) {
+template<int Bpp>
+int BasicPaint<Bpp>::GetHeight(void) {
     return this->height;
 }
 
-void Paint::SetHeight(int height) {
+template<int Bpp>
+void BasicPaint<Bpp>::SetHeight(int height) {
     this->height = height;
+    this->band_y = 0;
+    this->band_rows = height;
+    ResetClip();
 }
 
-int Paint::GetRotate(void) {
-    return this->rotate;
+/**
+ *  @brief: banded rendering: the frame buffer now holds only the absolute rows
+ *          y ... y + rows - 1 of a frame of frame_height rows (rows at most the rows
+ *          of the buffer). Drawing keeps the coordinates of the whole frame and is
+ *          clipped to the band; Clear clears the band. SetHeight ends the banded mode.
+ *          See Epd::DisplayBands.
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::SetBand(int y, int rows, int frame_height) {
+    this->height = frame_height;
+    this->band_y = y;
+    this->band_rows = rows;
+    ResetClip();
 }
 
-void Paint::SetRotate(int rotate){
-    this->rotate = rotate;
+/**
+ *  @brief: the first absolute row held by the frame buffer (0 unless banded)
+ */
+template<int Bpp>
+int BasicPaint<Bpp>::GetBandY(void) {
+    return this->band_y;
 }
 
 /**
- *  @brief: this draws a pixel by the coordinates
+ *  @brief: the absolute rows held by the frame buffer (GetHeight() unless banded)
  */
-void Paint::DrawPixel(int x, int y, int colored) {
-    int point_temp;
-    if (this->rotate == ROTATE_0) {
-        if(x < 0 || x >= this->width || y < 0 || y >= this->height) {
-            return;
-        }
-        DrawAbsolutePixel(x, y, colored);
-    } else if (this->rotate == ROTATE_90) {
-        if(x < 0 || x >= this->height || y < 0 || y >= this->width) {
-          return;
-        }
-        point_temp = x;
-        x = this->width - y;
-        y = point_temp;
-        DrawAbsolutePixel(x, y, colored);
-    } else if (this->rotate == ROTATE_180) {
-        if(x < 0 || x >= this->width || y < 0 || y >= this->height) {
-          return;
-        }
-        x = this->width - x;
-        y = this->height - y;
-        DrawAbsolutePixel(x, y, colored);
-    } else if (this->rotate == ROTATE_270) {
-        if(x < 0 || x >= this->height || y < 0 || y >= this->width) {
-          return;
-        }
-        point_temp = x;
-        x = y;
-        y = this->height - point_temp;
-        DrawAbsolutePixel(x, y, colored);
+template<int Bpp>
+int BasicPaint<Bpp>::GetBandRows(void) {
+    return this->band_rows;
+}
+
+template<int Bpp>
+int BasicPaint<Bpp>::GetRotate(void) {
+    return this->rotate;
+}
+
+/**
+ *  @brief: besides storing the orientation, this selects the pixel, span and glyph
+ *          routines specialised for it (and for both pixel values), so that the
+ *          drawing loops do not test the orientation or the color any more.
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::SetRotate(int rotate){
+    this->rotate = rotate;
+    switch (rotate) {
+    case ROTATE_90:
+        SelectPipeline<ROTATE_90>();
+        break;
+    case ROTATE_180:
+        SelectPipeline<ROTATE_180>();
+        break;
+    case ROTATE_270:
+        SelectPipeline<ROTATE_270>();
+        break;
+    default:
+        this->rotate = ROTATE_0;
+        SelectPipeline<ROTATE_0>();
+        break;
     }
+    ResetClip();
 }
 
 /**
- *  @brief: this draws a charactor on the frame buffer but not refresh
+ *  @brief: characters are drawn through the given cache; NULL draws them from the font
  */
-void Paint::DrawCharAt(int x, int y, char ascii_char, sFONT* font, int colored) {
-    int i, j;
-    unsigned int char_offset = (ascii_char - ' ') * font->Height * (font->Width / 8 + (font->Width % 8 ? 1 : 0));
-    const unsigned char* ptr = &font->table[char_offset];
+template<int Bpp>
+void BasicPaint<Bpp>::SetGlyphCache(GlyphCache* cache) {
+    this->glyph_cache = cache;
+}
 
-    for (j = 0; j < font->Height; j++) {
-        for (i = 0; i < font->Width; i++) {
-            if (pgm_read_byte(ptr) & (0x80 >> (i % 8))) {
-                DrawPixel(x + i, y + j, colored);
-            }
-            if (i % 8 == 7) {
-                ptr++;
-            }
-        }
-        if (font->Width % 8 != 0) {
-            ptr++;
-        }
+/**
+ *  @brief: restricts the drawing to the logical rectangle x0, y0 ... x1, y1 (bounds
+ *          included), within the current clip rectangle, until the matching PopClip.
+ *          Every primitive is clipped to it as a whole (spans, glyph rows, blits), not
+ *          pixel by pixel. Up to CLIP_STACK_DEPTH rectangles can be nested; the clip
+ *          rectangles survive SetRotate, SetBand and the like, in logical coordinates.
+ *          returns 0 (and leaves the clip as it is) if the stack is full.
+ */
+template<int Bpp>
+int BasicPaint<Bpp>::PushClip(int x0, int y0, int x1, int y1) {
+    if (this->clip_depth >= CLIP_STACK_DEPTH) {
+        return 0;
     }
+    Rect& rect = clip_stack[this->clip_depth];
+    rect.x0 = x0 < x1 ? x0 : x1;
+    rect.y0 = y0 < y1 ? y0 : y1;
+    rect.x1 = x0 < x1 ? x1 : x0;
+    rect.y1 = y0 < y1 ? y1 : y0;
+    this->clip_depth++;
+    clip_x0 = rect.x0 > clip_x0 ? rect.x0 : clip_x0;
+    clip_y0 = rect.y0 > clip_y0 ? rect.y0 : clip_y0;
+    clip_x1 = rect.x1 < clip_x1 ? rect.x1 : clip_x1;
+    clip_y1 = rect.y1 < clip_y1 ? rect.y1 : clip_y1;
+    return 1;
 }
 
 /**
-*  @brief: this displays a string on the frame buffer but not refresh
-*/
-void Paint::DrawStringAt(int x, int y, const char* text, sFONT* font, int colored) {
-    const char* p_text = text;
-    unsigned int counter = 0;
-    int refcolumn = x;
-    
-    /* Send the string character by character on EPD */
-    while (*p_text != 0) {
-        /* Display one character on EPD */
-        DrawCharAt(refcolumn, y, *p_text, font, colored);
-        /* Decrement the column position by 16 */
-        refcolumn += font->Width;
-        /* Point on the next character */
-        p_text++;
-        counter++;
+ *  @brief: back to the clip rectangle of before the last PushClip
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::PopClip(void) {
+    if (this->clip_depth > 0) {
+        this->clip_depth--;
+        ResetClip();
     }
 }
 
+/* 8x8 Bayer ordered dither matrix: the order in which the pixels of a cell turn on */
+static const unsigned char BayerMatrix[64] PROGMEM = {
+     0, 32,  8, 40,  2, 34, 10, 42,
+    48, 16, 56, 24, 50, 18, 58, 26,
+    12, 44,  4, 36, 14, 46,  6, 38,
+    60, 28, 52, 20, 62, 30, 54, 22,
+     3, 35, 11, 43,  1, 33,  9, 41,
+    51, 19, 59, 27, 49, 17, 57, 25,
+    15, 47,  7, 39, 13, 45,  5, 37,
+    63, 31, 55, 23, 61, 29, 53, 21
+};
+
 /**
-*  @brief: this draws a line on the frame buffer
-*/
-void Paint::DrawLine(int x0, int y0, int x1, int y1, int colored) {
-    /* Bresenham algorithm */
-    int dx = x1 - x0 >= 0 ? x1 - x0 : x0 - x1;
-    int sx = x0 < x1 ? 1 : -1;
-    int dy = y1 - y0 <= 0 ? y1 - y0 : y0 - y1;
-    int sy = y0 < y1 ? 1 : -1;
-    int err = dx + dy;
+ *  @brief: fills (the Filled primitives, DrawThickLine, DrawAnnulusSegment and the
+ *          background of opaque text) are drawn with an 8x8 pattern instead of a plain
+ *          color: 8 rows of 8 pixels, leftmost pixel in the most significant bit, a set
+ *          bit in the colored given to the primitive and a clear bit in the other color.
+ *          The pattern is copied, and tiled from the top left corner of the frame buffer
+ *          (it does not rotate with SetRotate); it is applied as a byte mask by the span
+ *          fill, so a patterned fill costs the same as a plain one.
+ *          NULL goes back to plain fills. Outlines, lines and glyphs stay plain.
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::SetFillPattern(const unsigned char* pattern) {
+    this->fill_patterned = pattern != NULL;
+    if (pattern != NULL) {
+        memcpy(this->fill_pattern, pattern, sizeof(this->fill_pattern));
+    }
+}
 
-    while((x0 != x1) && (y0 != y1)) {
-        DrawPixel(x0, y0 , colored);
-        if (2 * err >= dy) {     
-            err += dy;
-            x0 += sx;
-        }
-        if (2 * err <= dx) {
-            err += dx; 
-            y0 += sy;
+/**
+ *  @brief: ordered dither fill pattern: level / 16 of the pixels (level 0 ... 16, see
+ *          DITHER_LEVELS) are drawn in the colored given to the primitive, spread by
+ *          the 8x8 Bayer matrix; gray looking areas without a gray shades refresh
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::SetFillLevel(int level) {
+    unsigned char pattern[8];
+    level = level < 0 ? 0 : (level > DITHER_LEVELS - 1 ? DITHER_LEVELS - 1 : level);
+    for (int row = 0; row < 8; row++) {
+        pattern[row] = 0;
+        for (int column = 0; column < 8; column++) {
+            if (pgm_read_byte(&BayerMatrix[row * 8 + column]) < level * 4) {
+                pattern[row] |= 0x80 >> column;
+            }
         }
     }
+    SetFillPattern(pattern);
 }
 
 /**
-*  @brief: this draws a horizontal line on the frame buffer
-*/
-void Paint::DrawHorizontalLine(int x, int y, int line_width, int colored) {
-    int i;
-    for (i = x; i < x + line_width; i++) {
-        DrawPixel(i, y, colored);
-    }
+ *  @brief: the fill pattern in use (see SetFillPattern), NULL for plain fills
+ */
+template<int Bpp>
+const unsigned char* BasicPaint<Bpp>::GetFillPattern(void) {
+    return this->fill_patterned ? this->fill_pattern : NULL;
 }
 
 /**
-*  @brief: this draws a vertical line on the frame buffer
-*/
-void Paint::DrawVerticalLine(int x, int y, int line_height, int colored) {
-    int i;
-    for (i = y; i < y + line_height; i++) {
-        DrawPixel(x, i, colored);
-    }
+ *  @brief: index of the routines drawing colored (INK(colored) at 1 bpp, 1 above), with
+ *          the value they write set up: the SET routines of a depth above 1 bpp write
+ *          ink_byte, the pixel value repeated over a byte
+ */
+template<int Bpp>
+int BasicPaint<Bpp>::Ink(int colored) {
+    this->ink_value = Bpp == 1 ? INK(colored) : (colored & PIXEL_MASK);
+    this->ink_byte = this->ink_value * (0xFF / PIXEL_MASK);
+    return Bpp == 1 ? this->ink_value : 1;
 }
 
 /**
-*  @brief: this draws a rectangle
-*/
-void Paint::DrawRectangle(int x0, int y0, int x1, int y1, int colored) {
-    int min_x, min_y, max_x, max_y;
-    min_x = x1 > x0 ? x0 : x1;
-    max_x = x1 > x0 ? x1 : x0;
-    min_y = y1 > y0 ? y0 : y1;
-    max_y = y1 > y0 ? y1 : y0;
-    
-    DrawHorizontalLine(min_x, min_y, max_x - min_x + 1, colored);
-    DrawHorizontalLine(min_x, max_y, max_x - min_x + 1, colored);
-    DrawVerticalLine(min_x, min_y, max_y - min_y + 1, colored);
-    DrawVerticalLine(max_x, min_y, max_y - min_y + 1, colored);
+ *  @brief: the same for the second color of a routine (the background of opaque text),
+ *          written by the routines with SET 0: INK(colored) at 1 bpp, 0 above
+ */
+template<int Bpp>
+int BasicPaint<Bpp>::Paper(int colored) {
+    int value = Bpp == 1 ? INK(colored) : (colored & PIXEL_MASK);
+    this->paper_byte = value * (0xFF / PIXEL_MASK);
+    return Bpp == 1 ? value : 0;
 }
 
 /**
-*  @brief: this draws a filled rectangle
-*/
-void Paint::DrawFilledRectangle(int x0, int y0, int x1, int y1, int colored) {
-    int min_x, min_y, max_x, max_y;
-    int i;
-    min_x = x1 > x0 ? x0 : x1;
-    max_x = x1 > x0 ? x1 : x0;
-    min_y = y1 > y0 ? y0 : y1;
-    max_y = y1 > y0 ? y1 : y0;
-    
-    for (i = min_x; i <= max_x; i++) {
-      DrawVerticalLine(i, min_y, max_y - min_y + 1, colored);
+ *  @brief: pixel value the routines of a fill are picked with: Ink(colored), or PATTERN
+ *          with the pattern bits set up for colored
+ */
+template<int Bpp>
+int BasicPaint<Bpp>::FillInk(int colored) {
+    int ink = Ink(colored);
+    if (!this->fill_patterned) {
+        return ink;
+    }
+    for (int row = 0; row < 8; row++) {
+        if (Bpp == 1) {
+            this->pattern_bits[row] = ink ? this->fill_pattern[row] : ~this->fill_pattern[row];
+        } else {
+            /* a byte mask of the pixels taking the ink, Bpp bytes per pattern row */
+            for (int n = 0; n < Bpp; n++) {
+                this->pattern_bits[row * Bpp + n] = ExpandBits((unsigned char)(this->fill_pattern[row] << (n * PIXELS_PER_BYTE)));
+            }
+        }
     }
+    return PATTERN;
 }
 
 /**
-*  @brief: this draws a circle
-*/
-void Paint::DrawCircle(int x, int y, int radius, int colored) {
-    /* Bresenham algorithm */
-    int x_pos = -radius;
-    int y_pos = 0;
-    int err = 2 - 2 * radius;
-    int e2;
+ *  @brief: dirty rectangles: the areas of the frame buffer written since the last
+ *          ClearDirty, in absolute coordinates, x and w multiple of 8: ready for
+ *          Epd::SetPartialWindow (see Epd::SetPartialWindows).
+ *          Every primitive adds its clipped bounding box. Two rectangles are merged when
+ *          their bounding box has at most slack pixels more than themselves; when the list
+ *          is full, the two rectangles whose merge wastes the least are merged.
+ */
+template<int Bpp>
+int BasicPaint<Bpp>::GetDirtyCount(void) {
+    return this->dirty_count;
+}
 
-    do {
-        DrawPixel(x - x_pos, y + y_pos, colored);
-        DrawPixel(x + x_pos, y + y_pos, colored);
-        DrawPixel(x + x_pos, y - y_pos, colored);
-        DrawPixel(x - x_pos, y - y_pos, colored);
-        e2 = err;
-        if (e2 <= y_pos) {
-            err += ++y_pos * 2 + 1;
-            if(-x_pos == y_pos && e2 <= x_pos) {
-              e2 = 0;
-            }
-        }
-        if (e2 > x_pos) {
-            err += ++x_pos * 2 + 1;
-        }
-    } while (x_pos <= 0);
+template<int Bpp>
+void BasicPaint<Bpp>::GetDirtyRect(int index, int& x, int& y, int& w, int& l) {
+    x = dirty[index].x0;
+    y = dirty[index].y0;
+    w = dirty[index].x1 - dirty[index].x0 + 1;
+    l = dirty[index].y1 - dirty[index].y0 + 1;
+}
+
+template<int Bpp>
+void BasicPaint<Bpp>::ClearDirty(void) {
+    this->dirty_count = 0;
 }
 
 /**
-*  @brief: this draws a filled circle
-*/
-void Paint::DrawFilledCircle(int x, int y, int radius, int colored) {
-    /* Bresenham algorithm */
-    int x_pos = -radius;
-    int y_pos = 0;
-    int err = 2 - 2 * radius;
-    int e2;
+ *  @brief: slack: pixels a merge may add to the upload. 0 merges only rectangles that
+ *          overlap or touch without waste, a large value tends to a single bounding box.
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::SetDirtyMerge(long slack) {
+    this->dirty_slack = slack;
+}
 
-    do {
-        DrawPixel(x - x_pos, y + y_pos, colored);
-        DrawPixel(x + x_pos, y + y_pos, colored);
-        DrawPixel(x + x_pos, y - y_pos, colored);
-        DrawPixel(x - x_pos, y - y_pos, colored);
-        DrawHorizontalLine(x + x_pos, y + y_pos, 2 * (-x_pos) + 1, colored);
-        DrawHorizontalLine(x + x_pos, y - y_pos, 2 * (-x_pos) + 1, colored);
-        e2 = err;
-        if (e2 <= y_pos) {
-            err += ++y_pos * 2 + 1;
-            if(-x_pos == y_pos && e2 <= x_pos) {
-                e2 = 0;
-            }
+/**
+ *  @brief: pixels the bounding box of a and b covers outside of a and b
+ */
+static long MergeWaste(int ax0, int ay0, int ax1, int ay1, int bx0, int by0, int bx1, int by1) {
+    long area_a = (long)(ax1 - ax0 + 1) * (ay1 - ay0 + 1);
+    long area_b = (long)(bx1 - bx0 + 1) * (by1 - by0 + 1);
+    long area_u = (long)((ax1 > bx1 ? ax1 : bx1) - (ax0 < bx0 ? ax0 : bx0) + 1) *
+                  ((ay1 > by1 ? ay1 : by1) - (ay0 < by0 ? ay0 : by0) + 1);
+    int ix0 = ax0 > bx0 ? ax0 : bx0;
+    int iy0 = ay0 > by0 ? ay0 : by0;
+    int ix1 = ax1 < bx1 ? ax1 : bx1;
+    int iy1 = ay1 < by1 ? ay1 : by1;
+    long area_i = (ix0 <= ix1 && iy0 <= iy1) ? (long)(ix1 - ix0 + 1) * (iy1 - iy0 + 1) : 0;
+    return area_u - area_a - area_b + area_i;
+}
+
+/**
+ *  @brief: adds the absolute area x0 ... x1, y0 ... y1 (ordered, inside the frame buffer)
+ *          to the dirty rectangles
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::MarkAbsoluteDirty(int x0, int y0, int x1, int y1) {
+    Rect rect;
+    int n, i, best_i, best_j;
+    long waste, best;
+
+    /* fast path: most drawing (a pixel, a glyph) falls inside an area already dirty */
+    for (n = 0; n < this->dirty_count; n++) {
+        const Rect& other = dirty[n];
+        if (x0 >= other.x0 && x1 <= other.x1 && y0 >= other.y0 && y1 <= other.y1) {
+            return;
         }
-        if(e2 > x_pos) {
-            err += ++x_pos * 2 + 1;
+    }
+    rect.x0 = x0 & ~7;
+    rect.x1 = x1 | 7;
+    rect.y0 = y0;
+    rect.y1 = y1;
+    /* merge with every rectangle close enough, the result may reach more of them */
+    for (n = 0; n < this->dirty_count; n++) {
+        Rect& other = dirty[n];
+        if (MergeWaste(rect.x0, rect.y0, rect.x1, rect.y1,
+                       other.x0, other.y0, other.x1, other.y1) <= this->dirty_slack) {
+            rect.x0 = other.x0 < rect.x0 ? other.x0 : rect.x0;
+            rect.y0 = other.y0 < rect.y0 ? other.y0 : rect.y0;
+            rect.x1 = other.x1 > rect.x1 ? other.x1 : rect.x1;
+            rect.y1 = other.y1 > rect.y1 ? other.y1 : rect.y1;
+            dirty[n] = dirty[--this->dirty_count];
+            n = -1;
         }
-    } while(x_pos <= 0);
+    }
+    if (this->dirty_count < DIRTY_RECTS) {
+        dirty[this->dirty_count++] = rect;
+        return;
+    }
+    /* full: the cheapest merge among the rectangles and the new one (index DIRTY_RECTS) */
+    best = -1;
+    best_i = 0;
+    best_j = 0;
+    for (n = 0; n < DIRTY_RECTS; n++) {
+        for (i = n + 1; i <= DIRTY_RECTS; i++) {
+            const Rect& b = i < DIRTY_RECTS ? dirty[i] : rect;
+            waste = MergeWaste(dirty[n].x0, dirty[n].y0, dirty[n].x1, dirty[n].y1, b.x0, b.y0, b.x1, b.y1);
+            if (best < 0 || waste < best) {
+                best = waste;
+                best_i = n;
+                best_j = i;
+            }
+        }
+    }
+    const Rect& b = best_j < DIRTY_RECTS ? dirty[best_j] : rect;
+    Rect& a = dirty[best_i];
+    a.x0 = b.x0 < a.x0 ? b.x0 : a.x0;
+    a.y0 = b.y0 < a.y0 ? b.y0 : a.y0;
+    a.x1 = b.x1 > a.x1 ? b.x1 : a.x1;
+    a.y1 = b.y1 > a.y1 ? b.y1 : a.y1;
+    if (best_j < DIRTY_RECTS) {
+        dirty[best_j] = rect;
+    }
 }
 
-/* END OF FILE */
-
+/**
+ *  @brief: adds the logical area x0 ... x1, y0 ... y1 (ordered) to the dirty rectangles,
+ *          clipped
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::MarkDirty(int x0, int y0, int x1, int y1) {
+    if (ClipToAbsolute(x0, y0, x1, y1)) {
+        MarkAbsoluteDirty(x0, y0, x1, y1);
+    }
+}
 
+/**
+ *  @brief: clips the logical rectangle x0 ... x1, y0 ... y1 (ordered) and turns it into
+ *          the absolute one, ordered. returns false if nothing is left.
+ */
+template<int Bpp>
+bool BasicPaint<Bpp>::ClipToAbsolute(int& x0, int& y0, int& x1, int& y1) {
+    int abs_x0, abs_y0, abs_x1, abs_y1;
+    if (x0 < clip_x0) {
+        x0 = clip_x0;
+    }
+    if (y0 < clip_y0) {
+        y0 = clip_y0;
+    }
+    if (x1 > clip_x1) {
+        x1 = clip_x1;
+    }
+    if (y1 > clip_y1) {
+        y1 = clip_y1;
+    }
+    if (x0 > x1 || y0 > y1) {
+        return false;
+    }
+    switch (this->rotate) {
+    case ROTATE_90:
+        abs_x0 = this->width - 1 - y1;
+        abs_x1 = this->width - 1 - y0;
+        abs_y0 = x0;
+        abs_y1 = x1;
+        break;
+    case ROTATE_180:
+        abs_x0 = this->width - 1 - x1;
+        abs_x1 = this->width - 1 - x0;
+        abs_y0 = this->height - 1 - y1;
+        abs_y1 = this->height - 1 - y0;
+        break;
+    case ROTATE_270:
+        abs_x0 = y0;
+        abs_x1 = y1;
+        abs_y0 = this->height - 1 - x1;
+        abs_y1 = this->height - 1 - x0;
+        break;
+    default:
+        abs_x0 = x0;
+        abs_x1 = x1;
+        abs_y0 = y0;
+        abs_y1 = y1;
+        break;
+    }
+    x0 = abs_x0;
+    y0 = abs_y0;
+    x1 = abs_x1;
+    y1 = abs_y1;
+    return true;
+}
 
+/**
+ *  @brief: the clip rectangle back to the whole logical surface, or to the band,
+ *          intersected with the rectangles on the clip stack
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::ResetClip(void) {
+    int band_first = this->band_y;
+    int band_last = this->band_y + this->band_rows - 1;
+    clip_x0 = 0;
+    clip_y0 = 0;
+    clip_x1 = (IS_PORTRAIT(this->rotate) ? this->height : this->width) - 1;
+    clip_y1 = (IS_PORTRAIT(this->rotate) ? this->width : this->height) - 1;
+    /* absolute rows are logical rows (ROTATE_0, ROTATE_180) or columns */
+    if (this->rotate == ROTATE_180 || this->rotate == ROTATE_270) {
+        band_first = this->height - 1 - (this->band_y + this->band_rows - 1);
+        band_last = this->height - 1 - this->band_y;
+    }
+    if (IS_PORTRAIT(this->rotate)) {
+        clip_x0 = band_first > clip_x0 ? band_first : clip_x0;
+        clip_x1 = band_last < clip_x1 ? band_last : clip_x1;
+    } else {
+        clip_y0 = band_first > clip_y0 ? band_first : clip_y0;
+        clip_y1 = band_last < clip_y1 ? band_last : clip_y1;
+    }
+    for (int n = 0; n < this->clip_depth; n++) {
+        const Rect& rect = clip_stack[n];
+        clip_x0 = rect.x0 > clip_x0 ? rect.x0 : clip_x0;
+        clip_y0 = rect.y0 > clip_y0 ? rect.y0 : clip_y0;
+        clip_x1 = rect.x1 < clip_x1 ? rect.x1 : clip_x1;
+        clip_y1 = rect.y1 < clip_y1 ? rect.y1 : clip_y1;
+    }
+}
 
+template<int Bpp>
+template<int R>
+void BasicPaint<Bpp>::SelectPipeline(void) {
+    plot_ops[0] = &BasicPaint::PlotAt<R, 0>;
+    plot_ops[1] = &BasicPaint::PlotAt<R, 1>;
+    plot_ops[PATTERN] = &BasicPaint::PlotAt<R, PATTERN>;
+    pixel_ops[0] = &BasicPaint::PixelAt<R, 0>;
+    pixel_ops[1] = &BasicPaint::PixelAt<R, 1>;
+    pixel_ops[PATTERN] = &BasicPaint::PixelAt<R, PATTERN>;
+    span_ops[0] = &BasicPaint::SpanAt<R, 0>;
+    span_ops[1] = &BasicPaint::SpanAt<R, 1>;
+    span_ops[PATTERN] = &BasicPaint::SpanAt<R, PATTERN>;
+    column_ops[0] = &BasicPaint::ColumnAt<R, 0>;
+    column_ops[1] = &BasicPaint::ColumnAt<R, 1>;
+    column_ops[PATTERN] = &BasicPaint::ColumnAt<R, PATTERN>;
+    rect_ops[0] = &BasicPaint::RectAt<R, 0>;
+    rect_ops[1] = &BasicPaint::RectAt<R, 1>;
+    rect_ops[PATTERN] = &BasicPaint::RectAt<R, PATTERN>;
+    line_ops[0] = &BasicPaint::LineAt<R, 0>;
+    line_ops[1] = &BasicPaint::LineAt<R, 1>;
+    line_ops[PATTERN] = &BasicPaint::LineAt<R, PATTERN>;
+    glyph_ops[0] = &BasicPaint::GlyphAt<R, 0, 0>;
+    glyph_ops[1] = &BasicPaint::GlyphAt<R, 1, 0>;
+    opaque_glyph_ops[0] = &BasicPaint::GlyphAt<R, 0, 1>;
+    opaque_glyph_ops[1] = &BasicPaint::GlyphAt<R, 1, 1>;
+    blit_op = &BasicPaint::BlitAt<R>;
+}
 
+/**
+ *  @brief: logical to absolute coordinates
+ */
+template<int Bpp>
+template<int R>
+inline void BasicPaint<Bpp>::MapPoint(int x, int y, int& abs_x, int& abs_y) {
+    if (R == ROTATE_0) {
+        abs_x = x;
+        abs_y = y;
+    } else if (R == ROTATE_90) {
+        abs_x = this->width - 1 - y;
+        abs_y = x;
+    } else if (R == ROTATE_180) {
+        abs_x = this->width - 1 - x;
+        abs_y = this->height - 1 - y;
+    } else {
+        abs_x = y;
+        abs_y = this->height - 1 - x;
+    }
+}
 
+/**
+ *  @brief: first byte of the absolute row y, in the band held by the frame buffer
+ */
+template<int Bpp>
+inline unsigned char* BasicPaint<Bpp>::AbsoluteRow(int y) {
+    return &image[(y - this->band_y) * RowBytes()];
+}
 
+/**
+ *  @brief: bytes of a frame buffer row
+ */
+template<int Bpp>
+inline int BasicPaint<Bpp>::RowBytes(void) {
+    return this->width >> PIXEL_SHIFT;
+}
 
+/**
+ *  @brief: bits of the absolute pixel x in its byte
+ */
+template<int Bpp>
+inline unsigned char BasicPaint<Bpp>::PixelMask(int x) {
+    return PIXEL_MASK << ((PIXELS_PER_BYTE - 1 - (x & (PIXELS_PER_BYTE - 1))) * Bpp);
+}
 
+/**
+ *  @brief: bits of the absolute pixels x ... to the end of its byte
+ */
+template<int Bpp>
+inline unsigned char BasicPaint<Bpp>::LeadMask(int x) {
+    return 0xFF >> ((x & (PIXELS_PER_BYTE - 1)) * Bpp);
+}
 
+/**
+ *  @brief: bits of the absolute pixels from the start of its byte ... x
+ */
+template<int Bpp>
+inline unsigned char BasicPaint<Bpp>::TrailMask(int x) {
+    return 0xFF << ((PIXELS_PER_BYTE - 1 - (x & (PIXELS_PER_BYTE - 1))) * Bpp);
+}
 
+/**
+ *  @brief: the first 8 / Bpp bits of a 1 bit per pixel byte (bitmap, glyph, pattern),
+ *          each widened to the bits of a pixel: a byte mask of the set pixels
+ */
+template<int Bpp>
+inline unsigned char BasicPaint<Bpp>::ExpandBits(unsigned char bits) {
+    unsigned char out = 0;
+    if (Bpp == 1) {
+        return bits;
+    }
+    for (int n = 0; n < PIXELS_PER_BYTE; n++) {
+        if (bits & (0x80 >> n)) {
+            out |= PIXEL_MASK << ((PIXELS_PER_BYTE - 1 - n) * Bpp);
+        }
+    }
+    return out;
+}
 
+/**
+ *  @brief: a byte of the value the SET routines write: all bits set or clear at 1 bpp,
+ *          the ink (SET 1) or paper (SET 0) value above
+ */
+template<int Bpp>
+template<int SET>
+inline unsigned char BasicPaint<Bpp>::ValueByte(void) {
+    if (Bpp == 1) {
+        return SET ? 0xFF : 0x00;
+    }
+    return SET ? this->ink_byte : this->paper_byte;
+}
 
+/**
+ *  @brief: the pattern of byte n of absolute row y: the bits to write and the mask of
+ *          the pixels written (all of them at 1 bpp, the set bits of the pattern above)
+ */
+template<int Bpp>
+inline void BasicPaint<Bpp>::PatternByte(int n, int y, unsigned char& bits, unsigned char& mask) {
+    if (Bpp == 1) {
+        bits = this->pattern_bits[y & 7];
+        mask = 0xFF;
+    } else {
+        bits = this->ink_byte;
+        mask = this->pattern_bits[(y & 7) * Bpp + (n & (Bpp - 1))];
+    }
+}
 
+/**
+ *  @brief: sets or resets an absolute pixel, no bounds check
+ */
+template<int Bpp>
+template<int SET>
+inline void BasicPaint<Bpp>::PlotAbsolute(int x, int y) {
+    unsigned char* byte = &AbsoluteRow(y)[x >> PIXEL_SHIFT];
+    unsigned char mask = PixelMask(x);
+    unsigned char bits, pattern_mask;
 
+    if (SET == PATTERN) {
+        PatternByte(x >> PIXEL_SHIFT, y, bits, pattern_mask);
+        mask &= pattern_mask;
+    } else {
+        bits = ValueByte<SET>();
+    }
+    *byte = (*byte & ~mask) | (bits & mask);
+}
 
+/**
+ *  @brief: span fill core: sets the absolute pixels x0 ... x1 of row y, whole bytes at once.
+ *          no bounds check.
+ */
+template<int Bpp>
+template<int SET>
+void BasicPaint<Bpp>::FillAbsoluteSpan(int x0, int x1, int y) {
+    unsigned char* row = AbsoluteRow(y);
+    int first = x0 >> PIXEL_SHIFT;
+    int last = x1 >> PIXEL_SHIFT;
+    unsigned char lead = LeadMask(x0);
+    unsigned char trail = TrailMask(x1);
+    unsigned char bits, mask;
 
+    if (first == last) {
+        lead &= trail;
+    }
+    if (SET == PATTERN && Bpp > 1) {
+        /* the pattern is a mask of the pixels taking the ink, one per byte of the row */
+        for (int n = first; n <= last; n++) {
+            PatternByte(n, y, bits, mask);
+            mask &= n == first ? lead : (n == last ? trail : 0xFF);
+            row[n] = (row[n] & ~mask) | (bits & mask);
+        }
+        return;
+    }
+    /* at 1 bpp the pattern row is a byte of both colors */
+    bits = SET == PATTERN ? pattern_bits[y & 7] : ValueByte<SET>();
+    row[first] = (row[first] & ~lead) | (bits & lead);
+    if (first != last) {
+        memset(&row[first + 1], bits, last - first - 1);
+        row[last] = (row[last] & ~trail) | (bits & trail);
+    }
+}
 
+/**
+ *  @brief: sets the absolute pixels y0 ... y1 of column x: one byte column, one mask.
+ *          no bounds check.
+ */
+template<int Bpp>
+template<int SET>
+void BasicPaint<Bpp>::FillAbsoluteColumn(int x, int y0, int y1) {
+    int stride = RowBytes();
+    unsigned char* byte = &AbsoluteRow(y0)[x >> PIXEL_SHIFT];
+    unsigned char mask = PixelMask(x);
+    unsigned char bits = ValueByte<SET>();
+    unsigned char pattern_mask, write = mask;
 
+    for (int y = y0; y <= y1; y++) {
+        if (SET == PATTERN) {
+            PatternByte(x >> PIXEL_SHIFT, y, bits, pattern_mask);
+            write = mask & pattern_mask;
+        }
+        *byte = (*byte & ~write) | (bits & write);
+        byte += stride;
+    }
+}
 
+/**
+ *  @brief: one pixel by logical coordinates, no bounds check
+ */
+template<int Bpp>
+template<int R, int SET>
+inline void BasicPaint<Bpp>::PlotAt(int x, int y) {
+    int abs_x, abs_y;
+    MapPoint<R>(x, y, abs_x, abs_y);
+    PlotAbsolute<SET>(abs_x, abs_y);
+}
 
+/**
+ *  @brief: one pixel by logical coordinates, clipped
+ */
+template<int Bpp>
+template<int R, int SET>
+void BasicPaint<Bpp>::PixelAt(int x, int y) {
+    if (x < clip_x0 || x > clip_x1 || y < clip_y0 || y > clip_y1) {
+        return;
+    }
+    PlotAt<R, SET>(x, y);
+}
 
+/**
+ *  @brief: logical horizontal run x0 ... x1 of row y: a frame buffer row
+ *          (ROTATE_0, ROTATE_180) or column (ROTATE_90, ROTATE_270)
+ */
+template<int Bpp>
+template<int R, int SET>
+void BasicPaint<Bpp>::SpanAt(int x0, int x1, int y) {
+    if (y < clip_y0 || y > clip_y1) {
+        return;
+    }
+    if (x0 < clip_x0) {
+        x0 = clip_x0;
+    }
+    if (x1 > clip_x1) {
+        x1 = clip_x1;
+    }
+    if (x0 > x1) {
+        return;
+    }
+    if (R == ROTATE_0) {
+        FillAbsoluteSpan<SET>(x0, x1, y);
+    } else if (R == ROTATE_90) {
+        FillAbsoluteColumn<SET>(this->width - 1 - y, x0, x1);
+    } else if (R == ROTATE_180) {
+        FillAbsoluteSpan<SET>(this->width - 1 - x1, this->width - 1 - x0, this->height - 1 - y);
+    } else {
+        FillAbsoluteColumn<SET>(y, this->height - 1 - x1, this->height - 1 - x0);
+    }
+}
 
+/**
+ *  @brief: logical vertical run y0 ... y1 of column x
+ */
+template<int Bpp>
+template<int R, int SET>
+void BasicPaint<Bpp>::ColumnAt(int x, int y0, int y1) {
+    if (x < clip_x0 || x > clip_x1) {
+        return;
+    }
+    if (y0 < clip_y0) {
+        y0 = clip_y0;
+    }
+    if (y1 > clip_y1) {
+        y1 = clip_y1;
+    }
+    if (y0 > y1) {
+        return;
+    }
+    if (R == ROTATE_0) {
+        FillAbsoluteColumn<SET>(x, y0, y1);
+    } else if (R == ROTATE_90) {
+        FillAbsoluteSpan<SET>(this->width - 1 - y1, this->width - 1 - y0, x);
+    } else if (R == ROTATE_180) {
+        FillAbsoluteColumn<SET>(this->width - 1 - x, this->height - 1 - y1, this->height - 1 - y0);
+    } else {
+        FillAbsoluteSpan<SET>(y0, y1, this->height - 1 - x);
+    }
+}
+
+/**
+ *  @brief: logical rectangle x0 ... x1, y0 ... y1 (ordered), filled as frame buffer rows
+ */
+template<int Bpp>
+template<int R, int SET>
+void BasicPaint<Bpp>::RectAt(int x0, int y0, int x1, int y1) {
+    int abs_x0, abs_y0, abs_x1, abs_y1, tmp;
+    if (x0 < clip_x0) {
+        x0 = clip_x0;
+    }
+    if (y0 < clip_y0) {
+        y0 = clip_y0;
+    }
+    if (x1 > clip_x1) {
+        x1 = clip_x1;
+    }
+    if (y1 > clip_y1) {
+        y1 = clip_y1;
+    }
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+    MapPoint<R>(x0, y0, abs_x0, abs_y0);
+    MapPoint<R>(x1, y1, abs_x1, abs_y1);
+    if (abs_x0 > abs_x1) {
+        tmp = abs_x0;
+        abs_x0 = abs_x1;
+        abs_x1 = tmp;
+    }
+    if (abs_y0 > abs_y1) {
+        tmp = abs_y0;
+        abs_y0 = abs_y1;
+        abs_y1 = tmp;
+    }
+    for (int y = abs_y0; y <= abs_y1; y++) {
+        FillAbsoluteSpan<SET>(abs_x0, abs_x1, y);
+    }
+}
+
+/**
+ *  @brief: writes a row of bits in row y of the frame buffer, whole bytes at once.
+ *          bits[1] bit 7 lands on column ax; bits[0] is a zero byte, and the row must be
+ *          followed by another one, so that the shifter reads no bound.
+ *          only the columns x0 ... x1 (within the bits and the frame buffer) are written:
+ *          set bits take SET, clear bits are left alone, or take !SET when OPAQUE.
+ *          the bits are 1 per pixel at every depth. no bounds check.
+ */
+template<int Bpp>
+template<int SET, int OPAQUE>
+void BasicPaint<Bpp>::BlitAbsoluteRow(const unsigned char* bits, int ax, int x0, int x1, int y) {
+    unsigned char* row = AbsoluteRow(y);
+    int first = x0 >> PIXEL_SHIFT;
+    int last = x1 >> PIXEL_SHIFT;
+    /* bit offset in bits[] of the first column of byte first, counted from bits[0] bit 7 (>= 1) */
+    int offset = (first << PIXEL_SHIFT) - ax + 8;
+    unsigned char set = ValueByte<SET>();
+    unsigned char clear = ValueByte<!SET>();
+    const unsigned char* src;
+    unsigned char out, mask;
+
+    for (int n = first; n <= last; n++) {
+        src = &bits[offset >> 3];
+        out = ExpandBits((unsigned char)(((src[0] << 8) | src[1]) >> (8 - (offset & 7))));
+        mask = 0xFF;
+        if (n == first) {
+            mask &= LeadMask(x0);
+        }
+        if (n == last) {
+            mask &= TrailMask(x1);
+        }
+        if (OPAQUE) {
+            row[n] = (row[n] & ~mask) | (((out & set) | (~out & clear)) & mask);
+        } else {
+            row[n] = (row[n] & ~(out & mask)) | (set & out & mask);
+        }
+        offset += PIXELS_PER_BYTE;
+    }
+}
+
+/**
+ *  @brief: a cached glyph, box top left corner on absolute x, y. no bounds check.
+ *          at 1 bpp the cached bytes are frame buffer bytes; above, each row goes
+ *          through BlitAbsoluteRow (rows of at most GLYPH_ROW_BYTES bytes).
+ */
+template<int Bpp>
+template<int SET, int OPAQUE>
+void BasicPaint<Bpp>::BlitCachedGlyph(const GlyphCacheEntry* entry, int x, int y) {
+    int stride = RowBytes();
+    int row_bytes = entry->row_bytes;
+    const unsigned char* src = entry->bitmap;
+    unsigned char lead = 0xFF >> entry->shift;
+    unsigned char trail = 0xFF << ((8 - ((entry->shift + entry->width) & 7)) & 7);
+    unsigned char mask, bits;
+    int n;
+
+    if (Bpp > 1) {
+        unsigned char padded[GLYPH_ROW_BYTES + 2];
+        padded[0] = 0;
+        padded[row_bytes + 1] = 0;
+        for (n = 0; n < entry->height; n++) {
+            memcpy(&padded[1], src, row_bytes);
+            BlitAbsoluteRow<SET, OPAQUE>(padded, x - entry->shift, x, x + entry->width - 1, y + n);
+            src += row_bytes;
+        }
+        return;
+    }
+    unsigned char* row = &AbsoluteRow(y)[x >> 3];
+    if (row_bytes == 1) {
+        lead &= trail;
+    }
+    for (int r = entry->height; r > 0; r--) {
+        for (n = 0; n < row_bytes; n++) {
+            bits = src[n];
+            if (OPAQUE) {
+                mask = n == 0 ? lead : (n == row_bytes - 1 ? trail : 0xFF);
+                row[n] = (row[n] & ~mask) | ((SET ? bits : ~bits) & mask);
+            } else if (SET) {
+                row[n] |= bits;
+            } else {
+                row[n] &= ~bits;
+            }
+        }
+        row += stride;
+        src += row_bytes;
+    }
+}
+
+/**
+ *  @brief: bit order of a byte reversed
+ */
+static inline unsigned char ReverseBits(unsigned char b) {
+    b = (b >> 4) | (b << 4);
+    b = ((b & 0xCC) >> 2) | ((b & 0x33) << 2);
+    b = ((b & 0xAA) >> 1) | ((b & 0x55) << 1);
+    return b;
+}
+
+/**
+ *  @brief: one character, by logical coordinates.
+ *          the glyph box is intersected with the clip rectangle once, only the
+ *          visible rows and columns of the glyph are read.
+ *          ROTATE_0 and ROTATE_180 glyph rows are frame buffer rows: each one is shifted
+ *          into place (mirrored for ROTATE_180) and written as whole bytes; the other
+ *          orientations are drawn bit by bit. OPAQUE paints the background (!SET) too.
+ */
+template<int Bpp>
+template<int R, int SET, int OPAQUE>
+void BasicPaint<Bpp>::GlyphAt(int x, int y, char ascii_char, sFONT* font) {
+    int i, j, n;
+
+    /* whole glyphs only go through the cache, clipped ones are rare */
+    if (glyph_cache != NULL && x >= clip_x0 && x + font->Width - 1 <= clip_x1 &&
+        y >= clip_y0 && y + font->Height - 1 <= clip_y1) {
+        int abs_x0, abs_y0, abs_x1, abs_y1;
+        const GlyphCacheEntry* entry;
+        MapPoint<R>(x, y, abs_x0, abs_y0);
+        MapPoint<R>(x + font->Width - 1, y + font->Height - 1, abs_x1, abs_y1);
+        if (abs_x1 < abs_x0) {
+            abs_x0 = abs_x1;
+        }
+        if (abs_y1 < abs_y0) {
+            abs_y0 = abs_y1;
+        }
+        entry = glyph_cache->Fetch(font, ascii_char, R, abs_x0 & 7);
+        if (entry != NULL && (Bpp == 1 || entry->row_bytes <= GLYPH_ROW_BYTES)) {
+            BlitCachedGlyph<SET, OPAQUE>(entry, abs_x0, abs_y0);
+            return;
+        }
+    }
+
+    int row_bytes = font->Width / 8 + (font->Width % 8 ? 1 : 0);
+    unsigned int char_offset = (ascii_char - ' ') * font->Height * row_bytes;
+    int i0 = clip_x0 > x ? clip_x0 - x : 0;
+    int j0 = clip_y0 > y ? clip_y0 - y : 0;
+    int i1 = clip_x1 < x + font->Width - 1 ? clip_x1 - x : font->Width - 1;
+    int j1 = clip_y1 < y + font->Height - 1 ? clip_y1 - y : font->Height - 1;
+    const unsigned char* ptr = &font->table[char_offset + j0 * row_bytes];
+    unsigned char bits[GLYPH_ROW_BYTES + 2];
+
+    if ((R == ROTATE_0 || R == ROTATE_180) && row_bytes <= GLYPH_ROW_BYTES) {
+        if (i0 > i1) {
+            return;
+        }
+        bits[0] = 0;
+        bits[row_bytes + 1] = 0;
+        for (j = j0; j <= j1; j++) {
+            if (R == ROTATE_0) {
+                for (n = 0; n < row_bytes; n++) {
+                    bits[n + 1] = pgm_read_byte(&ptr[n]);
+                }
+                BlitAbsoluteRow<SET, OPAQUE>(bits, x, x + i0, x + i1, y + j);
+            } else {
+                for (n = 0; n < row_bytes; n++) {
+                    bits[row_bytes - n] = ReverseBits(pgm_read_byte(&ptr[n]));
+                }
+                BlitAbsoluteRow<SET, OPAQUE>(bits, this->width - x - row_bytes * 8,
+                                             this->width - 1 - x - i1, this->width - 1 - x - i0,
+                                             this->height - 1 - y - j);
+            }
+            ptr += row_bytes;
+        }
+        return;
+    }
+    for (j = j0; j <= j1; j++) {
+        for (i = i0; i <= i1; i++) {
+            if (pgm_read_byte(&ptr[i / 8]) & (0x80 >> (i % 8))) {
+                PlotAt<R, SET>(x + i, y + j);
+            } else if (OPAQUE) {
+                PlotAt<R, !SET>(x + i, y + j);
+            }
+        }
+        ptr += row_bytes;
+    }
+}
+
+/**
+ *  @brief: line steps of the major axis a, minor axis b.
+ *          step i of the line is (a0 + sa * i, b0 + sb * m(i)), i = 0 ... da, where
+ *          m(i) = floor((2 * i * db + da) / (2 * da)), that is i * db / da rounded.
+ *          this finds the steps first ... last that fall in the clip bounds, and the
+ *          minor offset and Bresenham error (2 * i * db + da) mod (2 * da) at the first one,
+ *          so that the walk starts clipped with the error it would have had unclipped.
+ *          returns false if no step is visible.
+ */
+static bool ClipLineSteps(int a0, int sa, int da, int a_min, int a_max,
+                          int b0, int sb, int db, int b_min, int b_max,
+                          long& first, long& last, long& minor, long& err) {
+    long long lo, hi, m_lo, m_hi, q;
+
+    /* major axis in bounds */
+    lo = sa > 0 ? (long long)a_min - a0 : (long long)a0 - a_max;
+    hi = sa > 0 ? (long long)a_max - a0 : (long long)a0 - a_min;
+    if (lo < 0) {
+        lo = 0;
+    }
+    if (hi > da) {
+        hi = da;
+    }
+    /* minor axis in bounds: m_lo <= m(i) <= m_hi */
+    m_lo = sb > 0 ? (long long)b_min - b0 : (long long)b0 - b_max;
+    m_hi = sb > 0 ? (long long)b_max - b0 : (long long)b0 - b_min;
+    if (db == 0) {
+        if (m_lo > 0 || m_hi < 0) {
+            return false;
+        }
+    } else {
+        /* m(i) >= m_lo  <=>  i >= (2 * da * m_lo - da) / (2 * db), rounded up */
+        q = 2LL * da * m_lo - da;
+        q = q > 0 ? (q + 2LL * db - 1) / (2LL * db) : -(-q / (2LL * db));
+        if (q > lo) {
+            lo = q;
+        }
+        /* m(i) <= m_hi  <=>  i <= (2 * da * (m_hi + 1) - da - 1) / (2 * db), rounded down */
+        q = 2LL * da * (m_hi + 1) - da - 1;
+        q = q >= 0 ? q / (2LL * db) : -((-q + 2LL * db - 1) / (2LL * db));
+        if (q < hi) {
+            hi = q;
+        }
+    }
+    if (lo > hi) {
+        return false;
+    }
+    first = (long)lo;
+    last = (long)hi;
+    if (da == 0) {
+        minor = 0;
+        err = 0;
+    } else {
+        q = 2LL * lo * db + da;
+        minor = (long)(q / (2LL * da));
+        err = (long)(q % (2LL * da));
+    }
+    return true;
+}
+
+/**
+ *  @brief: line x0, y0 ... x1, y1 (both ends drawn), clipped once then walked
+ *          by an unchecked Bresenham loop.
+ */
+template<int Bpp>
+template<int R, int SET>
+void BasicPaint<Bpp>::LineAt(int x0, int y0, int x1, int y1) {
+    int dx = x1 >= x0 ? x1 - x0 : x0 - x1;
+    int dy = y1 >= y0 ? y1 - y0 : y0 - y1;
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+    long first, last, minor, err, n;
+    int x, y;
+
+    if (dx >= dy) {
+        if (!ClipLineSteps(x0, sx, dx, clip_x0, clip_x1, y0, sy, dy, clip_y0, clip_y1,
+                           first, last, minor, err)) {
+            return;
+        }
+        x = x0 + sx * first;
+        y = y0 + sy * minor;
+        for (n = last - first; n >= 0; n--) {
+            PlotAt<R, SET>(x, y);
+            x += sx;
+            err += 2L * dy;
+            if (err >= 2L * dx) {
+                err -= 2L * dx;
+                y += sy;
+            }
+        }
+    } else {
+        if (!ClipLineSteps(y0, sy, dy, clip_y0, clip_y1, x0, sx, dx, clip_x0, clip_x1,
+                           first, last, minor, err)) {
+            return;
+        }
+        y = y0 + sy * first;
+        x = x0 + sx * minor;
+        for (n = last - first; n >= 0; n--) {
+            PlotAt<R, SET>(x, y);
+            y += sy;
+            err += 2L * dx;
+            if (err >= 2L * dy) {
+                err -= 2L * dy;
+                x += sx;
+            }
+        }
+    }
+}
+
+/**
+ *  @brief: this draws a pixel by the coordinates
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::DrawPixel(int x, int y, int colored) {
+    MarkDirty(x, y, x, y);
+    (this->*pixel_ops[Ink(colored)])(x, y);
+}
+
+/**
+ *  @brief: the character of a fixed width font drawn for the code point code: the fonts hold
+ *          ' ' ... '~', anything else is left blank
+ */
+static inline char FontChar(uint16_t code) {
+    return (code >= ' ' && code <= '~') ? (char)code : ' ';
+}
+
+/**
+ *  @brief: this draws a charactor on the frame buffer but not refresh
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::DrawCharAt(int x, int y, char ascii_char, sFONT* font, int colored) {
+    ascii_char = FontChar((unsigned char)ascii_char);
+    MarkDirty(x, y, x + font->Width - 1, y + font->Height - 1);
+    (this->*glyph_ops[Ink(colored)])(x, y, ascii_char, font);
+}
+
+/**
+ *  @brief: this draws an opaque charactor: the whole character box is painted,
+ *          the glyph in colored and the rest in background, in a single pass
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::DrawCharAt(int x, int y, char ascii_char, sFONT* font, int colored, int background) {
+    ascii_char = FontChar((unsigned char)ascii_char);
+    MarkDirty(x, y, x + font->Width - 1, y + font->Height - 1);
+    if (this->fill_patterned) {
+        /* the background takes the fill pattern, the glyph is drawn over it */
+        (this->*rect_ops[FillInk(background)])(x, y, x + font->Width - 1, y + font->Height - 1);
+        (this->*glyph_ops[Ink(colored)])(x, y, ascii_char, font);
+    } else {
+        int ink = Ink(colored);
+        Paper(background);
+        if (this->ink_byte == this->paper_byte) {
+            (this->*rect_ops[ink])(x, y, x + font->Width - 1, y + font->Height - 1);
+        } else {
+            (this->*opaque_glyph_ops[ink])(x, y, ascii_char, font);
+        }
+    }
+}
+
+/**
+*  @brief: this displays a UTF-8 string on the frame buffer but not refresh
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawStringAt(int x, int y, const char* text, sFONT* font, int colored) {
+    GlyphFunction glyph = glyph_ops[Ink(colored)];
+    const char* p_text = text;
+    int refcolumn = x;
+
+    MarkDirty(x, y, x + CountUtf8(text) * font->Width - 1, y + font->Height - 1);
+    /* Send the string character by character on EPD */
+    while (*p_text != 0) {
+        /* Display one character on EPD, and point on the next one */
+        (this->*glyph)(refcolumn, y, FontChar(DecodeUtf8(p_text)), font);
+        /* Decrement the column position by 16 */
+        refcolumn += font->Width;
+    }
+}
+
+/**
+*  @brief: this displays an opaque UTF-8 string (see DrawCharAt) on the frame buffer but not refresh
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawStringAt(int x, int y, const char* text, sFONT* font, int colored, int background) {
+    const char* p_text = text;
+    int refcolumn = x;
+
+    while (*p_text != 0) {
+        DrawCharAt(refcolumn, y, FontChar(DecodeUtf8(p_text)), font, colored, background);
+        refcolumn += font->Width;
+    }
+}
+
+/**
+*  @brief: this draws a character of a proportional font, x, y being the pen at the top of
+*          the line: the glyph is decoded a few rows at a time and blitted.
+*          returns the advance of the pen (0 if the font does not have the character).
+*/
+template<int Bpp>
+int BasicPaint<Bpp>::DrawCharAt(int x, int y, uint16_t code, const sPFONT* font, int colored) {
+    unsigned char rows[PFONT_BUFFER_BYTES];
+    Bitmap bitmap = {rows, 0, 0, 0};
+    sGlyph glyph;
+    int row_bytes, chunk, count;
+
+    if (!FindGlyph(font, code, glyph)) {
+        return 0;
+    }
+    row_bytes = (glyph.width + 7) / 8;
+    x += glyph.x_offset;
+    y += glyph.y_offset;
+    if (glyph.width == 0 || glyph.height == 0 || row_bytes > PFONT_BUFFER_BYTES ||
+        x > clip_x1 || x + glyph.width - 1 < clip_x0 || y > clip_y1 || y + glyph.height - 1 < clip_y0) {
+        return glyph.advance;
+    }
+    GlyphReader reader(font, glyph);
+    chunk = PFONT_BUFFER_BYTES / row_bytes;
+    bitmap.width = glyph.width;
+    Ink(colored);
+    for (int row = 0; row < glyph.height; row += chunk) {
+        count = glyph.height - row < chunk ? glyph.height - row : chunk;
+        for (int n = 0; n < count; n++) {
+            reader.ReadRow(rows + n * row_bytes);
+        }
+        bitmap.height = count;
+        Blit(bitmap, 0, 0, glyph.width, count, x, y + row, ROP_INK);
+    }
+    return glyph.advance;
+}
+
+/**
+*  @brief: this displays a UTF-8 string of a proportional font on the frame buffer but not
+*          refresh; characters the font does not have are skipped. returns its width.
+*/
+template<int Bpp>
+int BasicPaint<Bpp>::DrawStringAt(int x, int y, const char* text, const sPFONT* font, int colored) {
+    const char* p_text = text;
+    int refcolumn = x;
+
+    while (*p_text != 0) {
+        refcolumn += DrawCharAt(refcolumn, y, DecodeUtf8(p_text), font, colored);
+    }
+    return refcolumn - x;
+}
+
+/**
+*  @brief: the same over a background box of the line height
+*/
+template<int Bpp>
+int BasicPaint<Bpp>::DrawStringAt(int x, int y, const char* text, const sPFONT* font, int colored, int background) {
+    int width = GetTextWidth(font, text);
+    if (width > 0) {
+        DrawFilledRectangle(x, y, x + width - 1, y + font->height - 1, background);
+    }
+    return DrawStringAt(x, y, text, font, colored);
+}
+
+/**
+*  @brief: this draws a line on the frame buffer
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawLine(int x0, int y0, int x1, int y1, int colored) {
+    MarkDirty(x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0);
+    (this->*line_ops[Ink(colored)])(x0, y0, x1, y1);
+}
+
+/**
+*  @brief: this draws a horizontal line on the frame buffer
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawHorizontalLine(int x, int y, int line_width, int colored) {
+    MarkDirty(x, y, x + line_width - 1, y);
+    (this->*span_ops[Ink(colored)])(x, x + line_width - 1, y);
+}
+
+/**
+*  @brief: this draws a vertical line on the frame buffer
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawVerticalLine(int x, int y, int line_height, int colored) {
+    MarkDirty(x, y, x, y + line_height - 1);
+    (this->*column_ops[Ink(colored)])(x, y, y + line_height - 1);
+}
+
+/**
+*  @brief: this draws a rectangle
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawRectangle(int x0, int y0, int x1, int y1, int colored) {
+    int min_x, min_y, max_x, max_y;
+    min_x = x1 > x0 ? x0 : x1;
+    max_x = x1 > x0 ? x1 : x0;
+    min_y = y1 > y0 ? y0 : y1;
+    max_y = y1 > y0 ? y1 : y0;
+    
+    DrawHorizontalLine(min_x, min_y, max_x - min_x + 1, colored);
+    DrawHorizontalLine(min_x, max_y, max_x - min_x + 1, colored);
+    DrawVerticalLine(min_x, min_y, max_y - min_y + 1, colored);
+    DrawVerticalLine(max_x, min_y, max_y - min_y + 1, colored);
+}
+
+/**
+*  @brief: this draws a filled rectangle
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawFilledRectangle(int x0, int y0, int x1, int y1, int colored) {
+    int min_x, min_y, max_x, max_y;
+    min_x = x1 > x0 ? x0 : x1;
+    max_x = x1 > x0 ? x1 : x0;
+    min_y = y1 > y0 ? y0 : y1;
+    max_y = y1 > y0 ? y1 : y0;
+    
+    MarkDirty(min_x, min_y, max_x, max_y);
+    (this->*rect_ops[FillInk(colored)])(min_x, min_y, max_x, max_y);
+}
+
+/**
+*  @brief: this draws a circle
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawCircle(int x, int y, int radius, int colored) {
+    PixelFunction pixel;
+    if (radius < 0 || x + radius < clip_x0 || x - radius > clip_x1 ||
+        y + radius < clip_y0 || y - radius > clip_y1) {
+        return;
+    }
+    /* a circle inside the clip rectangle is plotted without per pixel checks */
+    if (x - radius >= clip_x0 && x + radius <= clip_x1 &&
+        y - radius >= clip_y0 && y + radius <= clip_y1) {
+        pixel = plot_ops[Ink(colored)];
+    } else {
+        pixel = pixel_ops[Ink(colored)];
+    }
+    MarkDirty(x - radius, y - radius, x + radius, y + radius);
+    /* Bresenham algorithm */
+    int x_pos = -radius;
+    int y_pos = 0;
+    int err = 2 - 2 * radius;
+    int e2;
+
+    do {
+        (this->*pixel)(x - x_pos, y + y_pos);
+        (this->*pixel)(x + x_pos, y + y_pos);
+        (this->*pixel)(x + x_pos, y - y_pos);
+        (this->*pixel)(x - x_pos, y - y_pos);
+        e2 = err;
+        if (e2 <= y_pos) {
+            err += ++y_pos * 2 + 1;
+            if(-x_pos == y_pos && e2 <= x_pos) {
+              e2 = 0;
+            }
+        }
+        if (e2 > x_pos) {
+            err += ++x_pos * 2 + 1;
+        }
+    } while (x_pos <= 0);
+}
+
+/**
+ *  @brief: raster operation ROP of the source bits src on the bits mask of *dst;
+ *          ROP_INK writes the bits of ink where src is set
+ */
+template<int ROP>
+static inline void ApplyRop(unsigned char* dst, unsigned char src, unsigned char mask, unsigned char ink) {
+    unsigned char result;
+    if (ROP == ROP_COPY) {
+        result = src;
+    } else if (ROP == ROP_OR) {
+        result = *dst | src;
+    } else if (ROP == ROP_AND) {
+        result = *dst & src;
+    } else if (ROP == ROP_XOR) {
+        result = *dst ^ src;
+    } else if (ROP == ROP_ERASE) {
+        result = *dst & ~src;
+    } else if (ROP == ROP_INK) {
+        result = (*dst & ~src) | (ink & src);
+    } else {
+        result = ~src;
+    }
+    *dst = (*dst & ~mask) | (result & mask);
+}
+
+/**
+ *  @brief: bitmap area to logical x, y, clipped beforehand. no bounds check.
+ */
+template<int Bpp>
+template<int R>
+void BasicPaint<Bpp>::BlitAt(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y, int rop) {
+    switch (rop) {
+    case ROP_OR:
+        BlitRop<R, ROP_OR>(src, src_x, src_y, width, height, x, y);
+        break;
+    case ROP_AND:
+        BlitRop<R, ROP_AND>(src, src_x, src_y, width, height, x, y);
+        break;
+    case ROP_XOR:
+        BlitRop<R, ROP_XOR>(src, src_x, src_y, width, height, x, y);
+        break;
+    case ROP_NOT_SRC:
+        BlitRop<R, ROP_NOT_SRC>(src, src_x, src_y, width, height, x, y);
+        break;
+    case ROP_ERASE:
+        BlitRop<R, ROP_ERASE>(src, src_x, src_y, width, height, x, y);
+        break;
+    case ROP_INK:
+        BlitRop<R, ROP_INK>(src, src_x, src_y, width, height, x, y);
+        break;
+    default:
+        BlitRop<R, ROP_COPY>(src, src_x, src_y, width, height, x, y);
+        break;
+    }
+}
+
+/**
+ *  @brief: in ROTATE_0 bitmap rows are frame buffer rows, copied a byte at a time;
+ *          the other orientations transpose or mirror the bitmap, pixel by pixel.
+ */
+template<int Bpp>
+template<int R, int ROP>
+void BasicPaint<Bpp>::BlitRop(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y) {
+    int src_stride = (src.width + 7) / 8;
+    int abs_x, abs_y, i, j, u;
+    const unsigned char* row;
+    unsigned char bit;
+
+    if (R == ROTATE_0) {
+        if (src.progmem) {
+            BlitAbsoluteRows<ROP, 1>(src, src_x, src_y, width, height, x, y);
+        } else {
+            BlitAbsoluteRows<ROP, 0>(src, src_x, src_y, width, height, x, y);
+        }
+        return;
+    }
+    for (j = 0; j < height; j++) {
+        row = &src.image[(src_y + j) * src_stride];
+        for (i = 0; i < width; i++) {
+            u = src_x + i;
+            bit = (src.progmem ? pgm_read_byte(&row[u >> 3]) : row[u >> 3]) & (0x80 >> (u & 7));
+            MapPoint<R>(x + i, y + j, abs_x, abs_y);
+            ApplyRop<ROP>(&AbsoluteRow(abs_y)[abs_x >> PIXEL_SHIFT],
+                          bit ? 0xFF : 0x00, PixelMask(abs_x), this->ink_byte);
+        }
+    }
+}
+
+/**
+ *  @brief: bitmap area to absolute x, y: each destination byte is the 16 bit window of
+ *          two consecutive source bytes, shifted; every source byte is read once.
+ *          byte-aligned areas skip the shifter, and ROP_COPY from RAM copies them with memcpy.
+ *          above 1 bpp each destination byte takes the 8 / Bpp source bits of its pixels,
+ *          widened. no bounds check.
+ */
+template<int Bpp>
+template<int ROP, int PGM>
+void BasicPaint<Bpp>::BlitAbsoluteRows(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y) {
+    int src_stride = (src.width + 7) / 8;
+    int first = x >> 3;
+    int count = ((x + width - 1) >> 3) - first;
+    unsigned char lead = 0xFF >> (x & 7);
+    unsigned char trail = 0xFF << (7 - ((x + width - 1) & 7));
+    /* source bit of the first bit of the first destination byte (-7 ... ) */
+    int origin = src_x - (x & 7);
+    int shift = (origin + 8) & 7;
+    int src_first = ((origin + 8) >> 3) - 1;
+    int src_last = (src_x + width - 1) >> 3;
+    unsigned char* dst;
+    const unsigned char* row;
+    unsigned char prev, cur;
+    int n, k;
+
+    if (Bpp > 1) {
+        first = x >> PIXEL_SHIFT;
+        count = ((x + width - 1) >> PIXEL_SHIFT) - first;
+        lead = LeadMask(x);
+        trail = TrailMask(x + width - 1);
+        if (count == 0) {
+            lead &= trail;
+        }
+        for (int j = 0; j < height; j++) {
+            dst = &AbsoluteRow(y + j)[first];
+            row = &src.image[(src_y + j) * src_stride];
+            for (n = 0; n <= count; n++) {
+                /* source bit of the first pixel of the byte, + 8 (>= 1) */
+                k = src_x + ((first + n) << PIXEL_SHIFT) - x + 8;
+                prev = (k >> 3) > 0 ? READ_BYTE(PGM, &row[(k >> 3) - 1]) : 0;
+                cur = (k >> 3) <= src_last ? READ_BYTE(PGM, &row[k >> 3]) : 0;
+                ApplyRop<ROP>(&dst[n], ExpandBits((unsigned char)(((prev << 8) | cur) >> (8 - (k & 7)))),
+                              n == 0 ? lead : (n == count ? trail : 0xFF), this->ink_byte);
+            }
+        }
+        return;
+    }
+    if (count == 0) {
+        lead &= trail;
+    }
+    for (int j = 0; j < height; j++) {
+        dst = &AbsoluteRow(y + j)[first];
+        row = &src.image[(src_y + j) * src_stride];
+        if (shift == 0) {
+            ApplyRop<ROP>(&dst[0], READ_BYTE(PGM, &row[src_first]), lead, this->ink_byte);
+            if (count > 0) {
+                if (ROP == ROP_COPY && !PGM) {
+                    memcpy(&dst[1], &row[src_first + 1], count - 1);
+                } else {
+                    for (n = 1; n < count; n++) {
+                        ApplyRop<ROP>(&dst[n], READ_BYTE(PGM, &row[src_first + n]), 0xFF, this->ink_byte);
+                    }
+                }
+                ApplyRop<ROP>(&dst[count], READ_BYTE(PGM, &row[src_first + count]), trail, this->ink_byte);
+            }
+            continue;
+        }
+        prev = src_first >= 0 ? READ_BYTE(PGM, &row[src_first]) : 0;
+        for (n = 0, k = src_first + 1; n <= count; n++, k++) {
+            cur = k <= src_last ? READ_BYTE(PGM, &row[k]) : 0;
+            ApplyRop<ROP>(&dst[n], (unsigned char)(((prev << 8) | cur) >> (8 - shift)),
+                          n == 0 ? lead : (n == count ? trail : 0xFF), this->ink_byte);
+            prev = cur;
+        }
+    }
+}
+
+/**
+ *  @brief: this copies the area src_x, src_y, width x height of a 1 bit per pixel
+ *          bitmap to x, y, combining it with the frame buffer by the raster operation
+ *          rop (ROP_COPY, ROP_OR, ROP_AND, ROP_XOR, ROP_NOT_SRC, ROP_ERASE) on the bits.
+ *          x, y are logical coordinates, the bitmap is rotated with the frame buffer.
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::Blit(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y, int rop) {
+    if (src_x < 0) {
+        x -= src_x;
+        width += src_x;
+        src_x = 0;
+    }
+    if (src_y < 0) {
+        y -= src_y;
+        height += src_y;
+        src_y = 0;
+    }
+    if (width > src.width - src_x) {
+        width = src.width - src_x;
+    }
+    if (height > src.height - src_y) {
+        height = src.height - src_y;
+    }
+    if (x < clip_x0) {
+        src_x += clip_x0 - x;
+        width -= clip_x0 - x;
+        x = clip_x0;
+    }
+    if (y < clip_y0) {
+        src_y += clip_y0 - y;
+        height -= clip_y0 - y;
+        y = clip_y0;
+    }
+    if (width > clip_x1 - x + 1) {
+        width = clip_x1 - x + 1;
+    }
+    if (height > clip_y1 - y + 1) {
+        height = clip_y1 - y + 1;
+    }
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    MarkDirty(x, y, x + width - 1, y + height - 1);
+    (this->*blit_op)(src, src_x, src_y, width, height, x, y, rop);
+}
+
+/**
+ *  @brief: the same from the frame buffer of another Paint: src_x, src_y are absolute
+ *          (frame buffer) coordinates in it, whatever its rotation. Of a banded src (see
+ *          SetBand) only the rows of its band are copied, the others are left as they are.
+ *          src must not be this Paint's frame buffer.
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::Blit(BasicPaint<1>& src, int src_x, int src_y, int width, int height, int x, int y, int rop) {
+    /* the buffer holds only the band rows: Blit clips the area to them */
+    Bitmap bitmap = {src.GetImage(), src.GetWidth(), src.GetBandRows(), 0};
+    Blit(bitmap, src_x, src_y - src.GetBandY(), width, height, x, y, rop);
+}
+
+/**
+ *  @brief: nearest neighbour scaled copy of the area src_x, src_y, src_width x src_height
+ *          of src (inside it) to the logical area x, y, width x height, with the raster
+ *          operation rop. Each pixel samples the source pixel under its center.
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::BlitScaled(const Bitmap& src, int src_x, int src_y, int src_width, int src_height,
+                       int x, int y, int width, int height, int rop) {
+    unsigned char row[SCALE_ROW_BYTES];
+    Bitmap bitmap = {row, 0, 1, 0};
+    int col_first = x < clip_x0 ? clip_x0 - x : 0;
+    int col_last = x + width - 1 > clip_x1 ? clip_x1 - x : width - 1;
+    int row_first = y < clip_y0 ? clip_y0 - y : 0;
+    int row_last = y + height - 1 > clip_y1 ? clip_y1 - y : height - 1;
+    int src_row_bytes = (src.width + 7) / 8;
+
+    if (src_x < 0 || src_y < 0 || src_width <= 0 || src_height <= 0 ||
+        src_x + src_width > src.width || src_y + src_height > src.height ||
+        col_first > col_last || row_first > row_last) {
+        return;
+    }
+    MarkDirty(x + col_first, y + row_first, x + col_last, y + row_last);
+    /* a few columns at a time, each source row being sampled once for all its copies */
+    for (int col = col_first; col <= col_last; col += SCALE_ROW_BYTES * 8) {
+        int columns = col_last - col + 1 < SCALE_ROW_BYTES * 8 ? col_last - col + 1 : SCALE_ROW_BYTES * 8;
+        int sampled = -1;
+        bitmap.width = columns;
+        for (int i = row_first; i <= row_last; i++) {
+            int sy = src_y + (int)(((2L * i + 1) * src_height) / (2L * height));
+            if (sy != sampled) {
+                const unsigned char* src_row = src.image + (long)sy * src_row_bytes;
+                memset(row, 0, (columns + 7) / 8);
+                for (int j = 0; j < columns; j++) {
+                    int sx = src_x + (int)(((2L * (col + j) + 1) * src_width) / (2L * width));
+                    if (READ_BYTE(src.progmem, src_row + sx / 8) & (0x80 >> (sx % 8))) {
+                        row[j / 8] |= 0x80 >> (j % 8);
+                    }
+                }
+                sampled = sy;
+            }
+            (this->*blit_op)(bitmap, 0, 0, columns, 1, x + col, y + i, rop);
+        }
+    }
+}
+
+/* the bits of a nibble each doubled: 0101 gives 00110011 */
+static const unsigned char BitDouble[16] PROGMEM = {
+    0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F,
+    0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF
+};
+
+/**
+ *  @brief: the factor bytes a byte of pixels expands to when scaled factor times
+ */
+static void ExpandByte(unsigned char bits, int factor, unsigned char* out) {
+    unsigned char high, low;
+    if (factor == 1) {
+        out[0] = bits;
+    } else if (factor == 8) {
+        for (int n = 0; n < 8; n++) {
+            out[n] = (bits & (0x80 >> n)) ? 0xFF : 0x00;
+        }
+    } else {
+        high = pgm_read_byte(&BitDouble[bits >> 4]);
+        low = pgm_read_byte(&BitDouble[bits & 0x0F]);
+        if (factor == 2) {
+            out[0] = high;
+            out[1] = low;
+        } else {
+            out[0] = pgm_read_byte(&BitDouble[high >> 4]);
+            out[1] = pgm_read_byte(&BitDouble[high & 0x0F]);
+            out[2] = pgm_read_byte(&BitDouble[low >> 4]);
+            out[3] = pgm_read_byte(&BitDouble[low & 0x0F]);
+        }
+    }
+}
+
+/**
+ *  @brief: scales src up by factor (1, 2, 4 or 8) into dst, a bitmap of width * factor x
+ *          height * factor: each source byte is expanded by table, each row then copied
+ *          factor - 1 times. returns 0 if factor is not supported.
+ */
+int UpscaleBits(const Bitmap& src, unsigned char* dst, int factor) {
+    int src_row_bytes = (src.width + 7) / 8;
+    int dst_row_bytes = (src.width * factor + 7) / 8;
+    unsigned char expanded[8];
+
+    if (factor != 1 && factor != 2 && factor != 4 && factor != 8) {
+        return 0;
+    }
+    for (int y = 0; y < src.height; y++) {
+        const unsigned char* src_row = src.image + (long)y * src_row_bytes;
+        unsigned char* dst_row = dst + (long)y * factor * dst_row_bytes;
+        int done = 0;
+        for (int n = 0; n < src_row_bytes; n++) {
+            ExpandByte(READ_BYTE(src.progmem, src_row + n), factor, expanded);
+            /* the last byte may expand past the end of the row */
+            int bytes = dst_row_bytes - done < factor ? dst_row_bytes - done : factor;
+            memcpy(dst_row + done, expanded, bytes);
+            done += bytes;
+        }
+        for (int n = 1; n < factor; n++) {
+            memcpy(dst_row + n * dst_row_bytes, dst_row, dst_row_bytes);
+        }
+    }
+    return 1;
+}
+
+/**
+ *  @brief: bytes needed by SaveRect for an area of width x height, in any orientation
+ */
+template<int Bpp>
+int BasicPaint<Bpp>::SaveBytes(int width, int height) {
+    int landscape = ((width + PIXELS_PER_BYTE - 1) / PIXELS_PER_BYTE + 1) * height;
+    int portrait = ((height + PIXELS_PER_BYTE - 1) / PIXELS_PER_BYTE + 1) * width;
+    return landscape > portrait ? landscape : portrait;
+}
+
+/**
+ *  @brief: copies the frame buffer under the logical area x, y, width x height (clipped)
+ *          to buffer (SaveBytes(width, height) bytes), as whole bytes of its rows.
+ *          RestoreRect puts it back; the clip rectangle must be the same by then.
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::SaveRect(int x, int y, int width, int height, unsigned char* buffer) {
+    int x0 = x, y0 = y, x1 = x + width - 1, y1 = y + height - 1;
+    if (!ClipToAbsolute(x0, y0, x1, y1)) {
+        return;
+    }
+    for (int row = y0; row <= y1; row++) {
+        memcpy(buffer, &AbsoluteRow(row)[x0 >> PIXEL_SHIFT], (x1 >> PIXEL_SHIFT) - (x0 >> PIXEL_SHIFT) + 1);
+        buffer += (x1 >> PIXEL_SHIFT) - (x0 >> PIXEL_SHIFT) + 1;
+    }
+}
+
+/**
+ *  @brief: puts back the area saved by SaveRect; the bits of the edge bytes outside
+ *          the area are left alone
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::RestoreRect(int x, int y, int width, int height, const unsigned char* buffer) {
+    int x0 = x, y0 = y, x1 = x + width - 1, y1 = y + height - 1;
+    int first, last;
+    unsigned char lead, trail;
+    unsigned char* row;
+
+    if (!ClipToAbsolute(x0, y0, x1, y1)) {
+        return;
+    }
+    MarkAbsoluteDirty(x0, y0, x1, y1);
+    first = x0 >> PIXEL_SHIFT;
+    last = x1 >> PIXEL_SHIFT;
+    lead = LeadMask(x0);
+    trail = TrailMask(x1);
+    if (first == last) {
+        lead &= trail;
+    }
+    for (int n = y0; n <= y1; n++) {
+        row = AbsoluteRow(n);
+        row[first] = (row[first] & ~lead) | (buffer[0] & lead);
+        if (first != last) {
+            memcpy(&row[first + 1], &buffer[1], last - first - 1);
+            row[last] = (row[last] & ~trail) | (buffer[last - first] & trail);
+        }
+        buffer += last - first + 1;
+    }
+}
+
+/**
+ *  @brief: half widths of the rows of the Bresenham circle drawn by DrawCircle,
+ *          from the center row outwards
+ */
+class CircleRows {
+public:
+    CircleRows(int radius) {
+        x_pos = -radius;
+        y_pos = 0;
+        err = 2 - 2 * radius;
+    }
+    int Next(void) {
+        int half_width = -x_pos;
+        int row = y_pos;
+        int e2;
+        /* the first point of a row is its outermost one: skip the others */
+        while (y_pos == row && x_pos <= 0) {
+            e2 = err;
+            if (e2 <= y_pos) {
+                err += ++y_pos * 2 + 1;
+                if(-x_pos == y_pos && e2 <= x_pos) {
+                    e2 = 0;
+                }
+            }
+            if(e2 > x_pos) {
+                err += ++x_pos * 2 + 1;
+            }
+        }
+        return half_width;
+    }
+
+private:
+    int x_pos;
+    int y_pos;
+    int err;
+};
+
+/**
+ *  @brief: half widths of the rows of an ellipse, from the center row outwards:
+ *          the pixels whose center is inside the ellipse of radii x_radius + 1/2, y_radius + 1/2
+ */
+class EllipseRows {
+public:
+    EllipseRows(int x_radius, int y_radius) {
+        a2 = (long long)(2 * x_radius + 1) * (2 * x_radius + 1);
+        b2 = (long long)(2 * y_radius + 1) * (2 * y_radius + 1);
+        half_width = x_radius;
+        dy = 0;
+    }
+    int Next(void) {
+        /* 4 * x^2 * (2 * y_radius + 1)^2 + 4 * dy^2 * (2 * x_radius + 1)^2 <= both squared */
+        while (half_width > 0 &&
+               4 * ((long long)half_width * half_width * b2 + (long long)dy * dy * a2) > a2 * b2) {
+            half_width--;
+        }
+        dy++;
+        return half_width;
+    }
+
+private:
+    long long a2;
+    long long b2;
+    int half_width;
+    int dy;
+};
+
+/**
+ *  @brief: fills a shape symmetric around the rectangle x0 ... x1, y0 ... y1, given by
+ *          the half widths of its rows (rows.Next()), radius rows above and below it.
+ *          every row is one span, written once.
+ */
+template<int Bpp>
+template<class ROWS>
+void BasicPaint<Bpp>::FillShape(ROWS rows, int x0, int y0, int x1, int y1, int radius, int colored) {
+    int ink = FillInk(colored);
+    SpanFunction span = span_ops[ink];
+    int half_width;
+
+    if (radius < 0 || y1 + radius < clip_y0 || y0 - radius > clip_y1) {
+        return;
+    }
+    half_width = rows.Next();
+    (this->*rect_ops[ink])(x0 - half_width, y0, x1 + half_width, y1);
+    for (int dy = 1; dy <= radius; dy++) {
+        if (y0 - dy < clip_y0 && y1 + dy > clip_y1) {
+            break;
+        }
+        half_width = rows.Next();
+        (this->*span)(x0 - half_width, x1 + half_width, y0 - dy);
+        (this->*span)(x0 - half_width, x1 + half_width, y1 + dy);
+    }
+}
+
+/**
+ *  @brief: outline of the same shapes as FillShape. a row is drawn from its edge in
+ *          to the edge of the next row out, so that the outline has no gap; the outermost
+ *          rows are drawn whole.
+ */
+template<int Bpp>
+template<class ROWS>
+void BasicPaint<Bpp>::OutlineShape(ROWS rows, int x0, int y0, int x1, int y1, int radius, int colored) {
+    SpanFunction span = span_ops[Ink(colored)];
+    ColumnFunction column = column_ops[Ink(colored)];
+    int half_width, next, inner, row;
+
+    if (radius < 0 || y1 + radius < clip_y0 || y0 - radius > clip_y1) {
+        return;
+    }
+    half_width = rows.Next();
+    if (y1 - y0 > 1) {
+        (this->*column)(x0 - half_width, y0 + 1, y1 - 1);
+        (this->*column)(x1 + half_width, y0 + 1, y1 - 1);
+    }
+    for (int dy = 0; dy <= radius; dy++) {
+        next = dy < radius ? rows.Next() : -1;
+        inner = next + 1 < half_width ? next + 1 : half_width;
+        for (row = y0 - dy; ; row = y1 + dy) {
+            if (next < 0 || x0 - inner >= x1 + inner - 1) {
+                (this->*span)(x0 - half_width, x1 + half_width, row);
+            } else {
+                (this->*span)(x0 - half_width, x0 - inner, row);
+                (this->*span)(x1 + inner, x1 + half_width, row);
+            }
+            if (row == y1 + dy) {
+                break;
+            }
+        }
+        half_width = next;
+    }
+}
+
+/**
+*  @brief: this draws a filled circle
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawFilledCircle(int x, int y, int radius, int colored) {
+    if (radius < 0 || x + radius < clip_x0 || x - radius > clip_x1) {
+        return;
+    }
+    MarkDirty(x - radius, y - radius, x + radius, y + radius);
+    FillShape(CircleRows(radius), x, y, x, y, radius, colored);
+}
+
+/**
+*  @brief: this draws an ellipse
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawEllipse(int x, int y, int x_radius, int y_radius, int colored) {
+    if (x_radius < 0 || x + x_radius < clip_x0 || x - x_radius > clip_x1) {
+        return;
+    }
+    MarkDirty(x - x_radius, y - y_radius, x + x_radius, y + y_radius);
+    OutlineShape(EllipseRows(x_radius, y_radius), x, y, x, y, y_radius, colored);
+}
+
+/**
+*  @brief: this draws a filled ellipse
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawFilledEllipse(int x, int y, int x_radius, int y_radius, int colored) {
+    if (x_radius < 0 || x + x_radius < clip_x0 || x - x_radius > clip_x1) {
+        return;
+    }
+    MarkDirty(x - x_radius, y - y_radius, x + x_radius, y + y_radius);
+    FillShape(EllipseRows(x_radius, y_radius), x, y, x, y, y_radius, colored);
+}
+
+/**
+*  @brief: this draws a rectangle with corners rounded to radius
+*          (at most half the shorter side)
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawRoundedRectangle(int x0, int y0, int x1, int y1, int radius, int colored) {
+    int min_x, min_y, max_x, max_y;
+    min_x = x1 > x0 ? x0 : x1;
+    max_x = x1 > x0 ? x1 : x0;
+    min_y = y1 > y0 ? y0 : y1;
+    max_y = y1 > y0 ? y1 : y0;
+    if (radius > (max_x - min_x) / 2) {
+        radius = (max_x - min_x) / 2;
+    }
+    if (radius > (max_y - min_y) / 2) {
+        radius = (max_y - min_y) / 2;
+    }
+    if (radius < 0) {
+        radius = 0;
+    }
+    MarkDirty(min_x, min_y, max_x, max_y);
+    OutlineShape(CircleRows(radius), min_x + radius, min_y + radius, max_x - radius, max_y - radius, radius, colored);
+}
+
+/**
+*  @brief: this draws a filled rectangle with corners rounded to radius
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawFilledRoundedRectangle(int x0, int y0, int x1, int y1, int radius, int colored) {
+    int min_x, min_y, max_x, max_y;
+    min_x = x1 > x0 ? x0 : x1;
+    max_x = x1 > x0 ? x1 : x0;
+    min_y = y1 > y0 ? y0 : y1;
+    max_y = y1 > y0 ? y1 : y0;
+    if (radius > (max_x - min_x) / 2) {
+        radius = (max_x - min_x) / 2;
+    }
+    if (radius > (max_y - min_y) / 2) {
+        radius = (max_y - min_y) / 2;
+    }
+    if (radius < 0) {
+        radius = 0;
+    }
+    MarkDirty(min_x, min_y, max_x, max_y);
+    FillShape(CircleRows(radius), min_x + radius, min_y + radius, max_x - radius, max_y - radius, radius, colored);
+}
+
+/**
+ *  @brief: a polygon edge in the active edge table of DrawFilledPolygon. Its x at the
+ *          current row is kept in fixed point with an exact fraction: x + remainder / dy,
+ *          0 <= remainder < dy, so that stepping down the rows never drifts (integers only).
+ */
+class PolygonEdge {
+public:
+    void Set(int xa, int ya, int xb, int yb) {
+        if (ya > yb) {
+            int swap = xa;
+            xa = xb;
+            xb = swap;
+            swap = ya;
+            ya = yb;
+            yb = swap;
+        }
+        x_top = xa;
+        y_top = ya;
+        y_end = yb;
+        dx = xb - xa;
+        dy = yb - ya;
+        /* dx = step * dy + remainder_step, 0 <= remainder_step < dy */
+        step = dx / dy;
+        remainder_step = dx % dy;
+        if (remainder_step < 0) {
+            step--;
+            remainder_step += dy;
+        }
+    }
+    /* x at row y, y_top <= y < y_end */
+    void Start(int y) {
+        long t = (long)(y - y_top) * dx;
+        long q = t / dy;
+        remainder = t % dy;
+        if (remainder < 0) {
+            q--;
+            remainder += dy;
+        }
+        x = x_top + q;
+    }
+    void Step(void) {
+        x += step;
+        remainder += remainder_step;
+        if (remainder >= dy) {
+            x++;
+            remainder -= dy;
+        }
+    }
+    /* first pixel at or right of the edge, last pixel at or left of it */
+    int Left(void) {
+        return remainder > 0 ? x + 1 : x;
+    }
+    int Right(void) {
+        return x;
+    }
+    bool Before(const PolygonEdge& other) {
+        if (x != other.x) {
+            return x < other.x;
+        }
+        return (long long)remainder * other.dy < (long long)other.remainder * dy;
+    }
+
+    int y_top;
+    int y_end;
+
+private:
+    int x_top;
+    long dx;
+    long dy;
+    int x;
+    int step;
+    long remainder;
+    long remainder_step;
+};
+
+/**
+*  @brief: this draws the outline of a polygon: count vertices, points holding
+*          x0, y0, x1, y1 ... The last vertex is joined to the first one.
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawPolygon(const int* points, int count, int colored) {
+    OutlinePolygon(points, count, Ink(colored));
+}
+
+/**
+ *  @brief: the polygon outline with the line routine of the given pixel value
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::OutlinePolygon(const int* points, int count, int ink) {
+    LineFunction line = line_ops[ink];
+    int min_x, min_y, max_x, max_y, n, next;
+
+    if (count < 1) {
+        return;
+    }
+    min_x = max_x = points[0];
+    min_y = max_y = points[1];
+    for (n = 1; n < count; n++) {
+        min_x = points[2 * n] < min_x ? points[2 * n] : min_x;
+        max_x = points[2 * n] > max_x ? points[2 * n] : max_x;
+        min_y = points[2 * n + 1] < min_y ? points[2 * n + 1] : min_y;
+        max_y = points[2 * n + 1] > max_y ? points[2 * n + 1] : max_y;
+    }
+    MarkDirty(min_x, min_y, max_x, max_y);
+    for (n = 0; n < count; n++) {
+        next = n + 1 < count ? n + 1 : 0;
+        (this->*line)(points[2 * n], points[2 * n + 1], points[2 * next], points[2 * next + 1]);
+    }
+}
+
+/**
+*  @brief: this draws a filled polygon, convex or not (even-odd rule: where edges cross,
+*          the areas covered twice are left out). A pixel is filled when its center is
+*          inside; the outline drawn by DrawPolygon is part of the fill. Every row is
+*          filled with spans, from an active edge table sorted by x.
+*          Polygons of more than POLYGON_VERTICES vertices are only outlined.
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawFilledPolygon(const int* points, int count, int colored) {
+    int ink = FillInk(colored);
+    SpanFunction span = span_ops[ink];
+    PolygonEdge edges[POLYGON_VERTICES];
+    PolygonEdge* active[POLYGON_VERTICES];
+    PolygonEdge* edge;
+    int edge_count = 0, active_count = 0, pending = 0;
+    int n, m, next, y, y_first, y_last;
+
+    if (count > POLYGON_VERTICES) {
+        OutlinePolygon(points, count, ink);
+        return;
+    }
+    /* edges sorted by their first row; horizontal ones are left to the outline */
+    for (n = 0; n < count; n++) {
+        next = n + 1 < count ? n + 1 : 0;
+        if (points[2 * n + 1] == points[2 * next + 1]) {
+            continue;
+        }
+        y = points[2 * n + 1] < points[2 * next + 1] ? points[2 * n + 1] : points[2 * next + 1];
+        for (m = edge_count; m > 0 && edges[m - 1].y_top > y; m--) {
+            edges[m] = edges[m - 1];
+        }
+        edges[m].Set(points[2 * n], points[2 * n + 1], points[2 * next], points[2 * next + 1]);
+        edge_count++;
+    }
+    if (edge_count > 0) {
+        y_first = edges[0].y_top;
+        y_last = edges[0].y_end;
+        for (n = 1; n < edge_count; n++) {
+            y_last = edges[n].y_end > y_last ? edges[n].y_end : y_last;
+        }
+        /* an edge covers the rows y_top ... y_end - 1; the last row is the outline's */
+        y_first = y_first > clip_y0 ? y_first : clip_y0;
+        y_last = y_last - 1 < clip_y1 ? y_last - 1 : clip_y1;
+        for (y = y_first; y <= y_last; y++) {
+            for (n = 0, m = 0; n < active_count; n++) {
+                if (active[n]->y_end > y) {
+                    active[m++] = active[n];
+                }
+            }
+            active_count = m;
+            while (pending < edge_count && edges[pending].y_top <= y) {
+                edge = &edges[pending++];
+                if (edge->y_end > y) {
+                    edge->Start(y);
+                    active[active_count++] = edge;
+                }
+            }
+            /* still sorted but where edges crossed since the last row */
+            for (n = 1; n < active_count; n++) {
+                edge = active[n];
+                for (m = n; m > 0 && edge->Before(*active[m - 1]); m--) {
+                    active[m] = active[m - 1];
+                }
+                active[m] = edge;
+            }
+            for (n = 0; n + 1 < active_count; n += 2) {
+                if (active[n]->Left() <= active[n + 1]->Right()) {
+                    (this->*span)(active[n]->Left(), active[n + 1]->Right(), y);
+                }
+            }
+            for (n = 0; n < active_count; n++) {
+                active[n]->Step();
+            }
+        }
+    }
+    OutlinePolygon(points, count, ink);
+}
+
+/**
+*  @brief: this draws a triangle
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, int colored) {
+    int points[6] = {x0, y0, x1, y1, x2, y2};
+    DrawPolygon(points, 3, colored);
+}
+
+/**
+*  @brief: this draws a filled triangle
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawFilledTriangle(int x0, int y0, int x1, int y1, int x2, int y2, int colored) {
+    int points[6] = {x0, y0, x1, y1, x2, y2};
+    DrawFilledPolygon(points, 3, colored);
+}
+
+/* sin of 0 ... 90 degrees, times 16384 */
+static const unsigned short SineTable[91] PROGMEM = {
+    0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+    2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+    5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+    8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+    10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+    12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+    14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+    15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+    16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+    16384
+};
+
+/**
+ *  @brief: sin of an angle in whole degrees (0 ... 359), times 16384
+ */
+static long Sine(int angle) {
+    if (angle >= 180) {
+        return -Sine(angle - 180);
+    }
+    return pgm_read_word(&SineTable[angle <= 90 ? angle : 180 - angle]);
+}
+
+/**
+ *  @brief: integer square root (floor)
+ */
+static unsigned long long SquareRoot(unsigned long long value) {
+    unsigned long long root = 0;
+    unsigned long long bit = 1ULL << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+/**
+ *  @brief: narrows first ... last to the x where a * x <= b
+ */
+static void KeepAtMost(long long a, long long b, long& first, long& last) {
+    long long bound;
+    if (a == 0) {
+        if (b < 0) {
+            last = first - 1;
+        }
+    } else if (a > 0) {
+        /* floor(b / a) */
+        bound = b >= 0 ? b / a : -((-b + a - 1) / a);
+        last = bound < last ? bound : last;
+    } else {
+        /* ceil(b / a) = ceil(-b / -a) */
+        bound = -b >= 0 ? (-b - a - 1) / -a : -(b / -a);
+        first = bound > first ? bound : first;
+    }
+}
+
+/**
+*  @brief: this draws a line thickness pixels wide, as spans. The pixels whose center is
+*          at most thickness / 2 from the segment are drawn; the ends are cut square at the
+*          end points (CAP_BUTT), thickness / 2 beyond them (CAP_SQUARE) or rounded
+*          (CAP_ROUND). A thickness of 1 draws as DrawLine.
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawThickLine(int x0, int y0, int x1, int y1, int thickness, int cap, int colored) {
+    int ink = FillInk(colored);
+    SpanFunction span = span_ops[ink];
+    long long dx = x1 - x0;
+    long long dy = y1 - y0;
+    long long length2 = dx * dx + dy * dy;
+    long long w2 = (long long)thickness * thickness;
+    /* |distance to the line| * length <= reach, along the line 0 - reach ... length2 + reach */
+    long long reach = SquareRoot(w2 * length2 / 4);
+    long long t0 = cap == CAP_SQUARE ? -reach : 0;
+    long long t1 = cap == CAP_SQUARE ? length2 + reach : length2;
+    /* square corners stick out thickness / 2 * sqrt(2) at most */
+    int margin = (3 * thickness + 3) / 4;
+    int min_x = (x0 < x1 ? x0 : x1) - margin;
+    int max_x = (x0 < x1 ? x1 : x0) + margin;
+    int min_y = (y0 < y1 ? y0 : y1) - margin;
+    int max_y = (y0 < y1 ? y1 : y0) + margin;
+    long first, last, end_first, end_last, half_width;
+    int y, end;
+
+    if (thickness <= 1) {
+        MarkDirty(x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0);
+        (this->*line_ops[ink])(x0, y0, x1, y1);
+        return;
+    }
+    MarkDirty(min_x, min_y, max_x, max_y);
+    min_y = min_y > clip_y0 ? min_y : clip_y0;
+    max_y = max_y < clip_y1 ? max_y : clip_y1;
+    for (y = min_y; y <= max_y; y++) {
+        first = min_x;
+        last = max_x;
+        if (length2 == 0) {
+            /* a point: a square, or the round caps alone */
+            if (cap == CAP_ROUND || 2 * (y - y0) > thickness || 2 * (y0 - y) > thickness) {
+                last = first - 1;
+            } else {
+                first = x0 - thickness / 2;
+                last = x0 + thickness / 2;
+            }
+        } else {
+            /* -reach <= dx * (y - y0) - dy * (x - x0) <= reach */
+            KeepAtMost(-dy, reach - dx * (y - y0) - dy * x0, first, last);
+            KeepAtMost(dy, reach + dx * (y - y0) + dy * x0, first, last);
+            /* t0 <= dx * (x - x0) + dy * (y - y0) <= t1 */
+            KeepAtMost(-dx, dy * (y - y0) - dx * x0 - t0, first, last);
+            KeepAtMost(dx, t1 - dy * (y - y0) + dx * x0, first, last);
+        }
+        if (cap == CAP_ROUND) {
+            for (end = 0; end < 2; end++) {
+                long long row = y - (end ? y1 : y0);
+                if (4 * row * row > w2) {
+                    continue;
+                }
+                half_width = SquareRoot(w2 - 4 * row * row) / 2;
+                end_first = (end ? x1 : x0) - half_width;
+                end_last = (end ? x1 : x0) + half_width;
+                if (first > last) {
+                    first = end_first;
+                    last = end_last;
+                } else {
+                    first = end_first < first ? end_first : first;
+                    last = end_last > last ? end_last : last;
+                }
+            }
+        }
+        if (first <= last) {
+            (this->*span)(first, last, y);
+        }
+    }
+}
+
+/**
+*  @brief: this draws a part of a ring: the pixels whose center is more than
+*          inner_radius - 1/2 and at most outer_radius + 1/2 from x, y, from start_angle
+*          to end_angle. Angles are in degrees, clockwise from 3 o'clock (the y axis
+*          going down); a sweep of 360 degrees or more draws the whole ring.
+*          Every row is drawn as at most four spans.
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawAnnulusSegment(int x, int y, int inner_radius, int outer_radius,
+                               int start_angle, int end_angle, int colored) {
+    FillAnnulus(x, y, inner_radius, outer_radius, start_angle, end_angle, FillInk(colored));
+}
+
+/**
+ *  @brief: the annulus segment with the span routine of the given pixel value
+ */
+template<int Bpp>
+void BasicPaint<Bpp>::FillAnnulus(int x, int y, int inner_radius, int outer_radius,
+                        int start_angle, int end_angle, int ink) {
+    SpanFunction span = span_ops[ink];
+    long pieces[2][2];
+    long rays[2][2];
+    long first, last, half_width, start_x, start_y, end_x, end_y;
+    long long outer2, inner2, row2;
+    int piece_count, ray_count, sweep, dy, dy_first, dy_last, n, m;
+
+    if (inner_radius > outer_radius) {
+        n = inner_radius;
+        inner_radius = outer_radius;
+        outer_radius = n;
+    }
+    sweep = end_angle - start_angle >= 360 ? 360 : ((end_angle - start_angle) % 360 + 360) % 360;
+    if (sweep == 0 || outer_radius < 0 || x + outer_radius < clip_x0 || x - outer_radius > clip_x1 ||
+        y + outer_radius < clip_y0 || y - outer_radius > clip_y1) {
+        return;
+    }
+    MarkDirty(x - outer_radius, y - outer_radius, x + outer_radius, y + outer_radius);
+    outer2 = (long long)(2 * outer_radius + 1) * (2 * outer_radius + 1);
+    inner2 = inner_radius > 0 ? (long long)(2 * inner_radius - 1) * (2 * inner_radius - 1) : -1;
+    start_angle = (start_angle % 360 + 360) % 360;
+    end_angle = (start_angle + sweep) % 360;
+    start_x = Sine((start_angle + 90) % 360);
+    start_y = Sine(start_angle);
+    end_x = Sine((end_angle + 90) % 360);
+    end_y = Sine(end_angle);
+
+    dy_first = y - outer_radius > clip_y0 ? -outer_radius : clip_y0 - y;
+    dy_last = y + outer_radius < clip_y1 ? outer_radius : clip_y1 - y;
+    for (dy = dy_first; dy <= dy_last; dy++) {
+        /* the ring on this row, relative to x */
+        row2 = 4LL * dy * dy;
+        half_width = SquareRoot(outer2 - row2) / 2;
+        if (row2 <= inner2) {
+            pieces[0][0] = -half_width;
+            pieces[0][1] = -(long)(SquareRoot(inner2 - row2) / 2) - 1;
+            pieces[1][0] = -pieces[0][1];
+            pieces[1][1] = half_width;
+            piece_count = pieces[0][0] <= pieces[0][1] ? 2 : 0;
+        } else {
+            pieces[0][0] = -half_width;
+            pieces[0][1] = half_width;
+            piece_count = 1;
+        }
+        /* the angles on this row: the cross products start x p >= 0 and p x end >= 0 hold
+           both (sweep up to 180 degrees) or either (beyond) */
+        for (n = 0; n < 2; n++) {
+            rays[n][0] = -half_width;
+            rays[n][1] = half_width;
+        }
+        if (sweep < 360) {
+            KeepAtMost(start_y, start_x * dy, rays[0][0], rays[0][1]);
+            KeepAtMost(-end_y, -end_x * dy, rays[sweep <= 180 ? 0 : 1][0], rays[sweep <= 180 ? 0 : 1][1]);
+        }
+        ray_count = sweep <= 180 || sweep == 360 ? 1 : 2;
+        for (n = 0; n < piece_count; n++) {
+            for (m = 0; m < ray_count; m++) {
+                first = pieces[n][0] > rays[m][0] ? pieces[n][0] : rays[m][0];
+                last = pieces[n][1] < rays[m][1] ? pieces[n][1] : rays[m][1];
+                if (first <= last) {
+                    (this->*span)(x + first, x + last, y + dy);
+                }
+            }
+        }
+    }
+}
+
+/**
+*  @brief: this draws an arc of a circle, from start_angle to end_angle
+*          (see DrawAnnulusSegment)
+*/
+template<int Bpp>
+void BasicPaint<Bpp>::DrawArc(int x, int y, int radius, int start_angle, int end_angle, int colored) {
+    FillAnnulus(x, y, radius, radius, start_angle, end_angle, Ink(colored));
+}
+
+/**
+ *  @brief: value of pixel x of a frame buffer row of Bpp bits per pixel
+ */
+template<int Bpp>
+static inline int RowPixel(const unsigned char* row, int x) {
+    unsigned int u = x;
+    return (row[u / (8 / Bpp)] >> ((8 / Bpp - 1 - u % (8 / Bpp)) * Bpp)) & ((1 << Bpp) - 1);
+}
+
+/**
+ *  @brief: from x (of value value), the leftmost x of the run of value, not beyond limit;
+ *          whole bytes of value are skipped at once
+ */
+template<int Bpp>
+static int RunStart(const unsigned char* row, int x, int limit, int value) {
+    const int last = 8 / Bpp - 1;
+    unsigned char full = value * (0xFF / ((1 << Bpp) - 1));
+    while (x > limit) {
+        if (Bpp < 8 && (x & last) == last && x - last >= limit && row[(unsigned int)x / (8 / Bpp)] == full) {
+            x -= last;
+        } else if (RowPixel<Bpp>(row, x - 1) == value) {
+            x--;
+        } else {
+            break;
+        }
+    }
+    return x;
+}
+
+/**
+ *  @brief: from x (of value value), the rightmost x of the run of value, not beyond limit
+ */
+template<int Bpp>
+static int RunEnd(const unsigned char* row, int x, int limit, int value) {
+    const int last = 8 / Bpp - 1;
+    unsigned char full = value * (0xFF / ((1 << Bpp) - 1));
+    while (x < limit) {
+        if (Bpp < 8 && (x & last) == 0 && x + last <= limit && row[(unsigned int)x / (8 / Bpp)] == full) {
+            x += last;
+        } else if (RowPixel<Bpp>(row, x + 1) == value) {
+            x++;
+        } else {
+            break;
+        }
+    }
+    return x;
+}
+
+/**
+ *  @brief: the first x from x to limit of value value, or limit + 1; at 1 bpp bytes
+ *          without any are skipped at once
+ */
+template<int Bpp>
+static int NextPixel(const unsigned char* row, int x, int limit, int value) {
+    unsigned char none = value ? 0x00 : 0xFF;
+    while (x <= limit) {
+        if (Bpp == 1 && (x & 7) == 0 && row[x >> 3] == none) {
+            x += 8;
+        } else if (RowPixel<Bpp>(row, x) == value) {
+            return x;
+        } else {
+            x++;
+        }
+    }
+    return limit + 1;
+}
+
+/**
+*  @brief: this fills the area of the color found at x, y, bounded by other colors
+*          (4-connected) and by the clip rectangle, with colored. The area is walked by
+*          runs of frame buffer rows (Heckbert's seed fill): each run is found a byte at a
+*          time where possible and filled by the span fill; no recursion.
+*          stack is the work memory, stack_size entries given by the caller (8 bytes each).
+*          An entry is what is left to explore from a filled run, and the most recent one
+*          is worked on first, so the entries grow with the nesting of the area, not with
+*          its size: a comb of 100 teeth takes 2, a few dozen are enough for most drawings.
+*          A run is filled only once its entries fit, older entries going on meanwhile, so
+*          a stack too small never leaves the fill wrong, only unfinished: the worst case,
+*          a maze or a spiral, needs about three entries per branch or turn open at once.
+*          returns 1, or 0 if the stack ran out: parts of the area are then left.
+*          Fill patterns do not apply.
+*/
+template<int Bpp>
+int BasicPaint<Bpp>::FloodFill(int x, int y, int colored, FloodSpan* stack, int stack_size) {
+    int x0 = clip_x0, y0 = clip_y0, x1 = clip_x1, y1 = clip_y1;
+    int fill_x0, fill_y0, fill_x1, fill_y1;
+    int old_value, ink = Ink(colored);
+    int count = 0, complete = 1;
+    int n, left, right, first, last, dy, row_y, onward, needed;
+    unsigned char* row;
+
+    if (x < clip_x0 || x > clip_x1 || y < clip_y0 || y > clip_y1) {
+        return 1;
+    }
+    /* the area is the same in any orientation: it is walked in frame buffer rows */
+    ClipToAbsolute(x0, y0, x1, y1);
+    fill_x0 = fill_x1 = x;
+    fill_y0 = fill_y1 = y;
+    ClipToAbsolute(fill_x0, fill_y0, fill_x1, fill_y1);
+    x = fill_x0;
+    y = fill_y0;
+    row = AbsoluteRow(y);
+    old_value = RowPixel<Bpp>(row, x);
+    if (old_value == this->ink_value) {
+        return 1;
+    }
+    left = RunStart<Bpp>(row, x, x0, old_value);
+    right = RunEnd<Bpp>(row, x, x1, old_value);
+    if (ink) {
+        FillAbsoluteSpan<1>(left, right, y);
+    } else {
+        FillAbsoluteSpan<0>(left, right, y);
+    }
+    fill_x0 = left;
+    fill_x1 = right;
+    fill_y0 = fill_y1 = y;
+    for (dy = -1; dy <= 1; dy += 2) {
+        if (y + dy < y0 || y + dy > y1) {
+            continue;
+        }
+        if (count == stack_size) {
+            complete = 0;
+            break;
+        }
+        stack[count].x0 = left;
+        stack[count].x1 = right;
+        stack[count].y = y;
+        stack[count].dy = dy;
+        count++;
+    }
+
+    n = count - 1;
+    while (count > 0) {
+        if (n < 0) {
+            /* no entry can go on without more room */
+            complete = 0;
+            break;
+        }
+        /* the run first ... last of row y is filled: explore row y + dy along it */
+        first = stack[n].x0;
+        last = stack[n].x1;
+        dy = stack[n].dy;
+        row_y = stack[n].y + dy;
+        row = AbsoluteRow(row_y);
+        x = NextPixel<Bpp>(row, first, last, old_value);
+        if (x > last) {
+            stack[n] = stack[--count];
+            n = count - 1;
+            continue;
+        }
+        left = RunStart<Bpp>(row, x, x0, old_value);
+        right = RunEnd<Bpp>(row, x, x1, old_value);
+        /* onwards, and back where the run sticks out of the one it was found from; the
+           bits before first are not of the old color any more, so left < first only
+           happens on the first run found */
+        onward = row_y + dy >= y0 && row_y + dy <= y1;
+        needed = onward + (left < first) + (right > last) - (right >= last);
+        if (count + needed > stack_size) {
+            n--;
+            continue;
+        }
+        if (ink) {
+            FillAbsoluteSpan<1>(left, right, row_y);
+        } else {
+            FillAbsoluteSpan<0>(left, right, row_y);
+        }
+        fill_x0 = left < fill_x0 ? left : fill_x0;
+        fill_x1 = right > fill_x1 ? right : fill_x1;
+        fill_y0 = row_y < fill_y0 ? row_y : fill_y0;
+        fill_y1 = row_y > fill_y1 ? row_y : fill_y1;
+        if (right >= last) {
+            stack[n] = stack[--count];
+        } else {
+            stack[n].x0 = right + 1;
+        }
+        if (left < first) {
+            stack[count].x0 = left;
+            stack[count].x1 = first - 1;
+            stack[count].y = row_y;
+            stack[count].dy = -dy;
+            count++;
+        }
+        if (right > last) {
+            stack[count].x0 = last + 1;
+            stack[count].x1 = right;
+            stack[count].y = row_y;
+            stack[count].dy = -dy;
+            count++;
+        }
+        if (onward) {
+            stack[count].x0 = left;
+            stack[count].x1 = right;
+            stack[count].y = row_y;
+            stack[count].dy = dy;
+            count++;
+        }
+        n = count - 1;
+    }
+    MarkAbsoluteDirty(fill_x0, fill_y0, fill_x1, fill_y1);
+    return complete;
+}
+
+/**
+ *  GlyphCache
+ */
+GlyphCache::GlyphCache(GlyphCacheEntry* entries, unsigned char* bitmaps, int slots, int slot_bytes) {
+    this->entries = entries;
+    this->slots = slots;
+    this->slot_bytes = slot_bytes;
+    for (int n = 0; n < slots; n++) {
+        entries[n].bitmap = &bitmaps[n * slot_bytes];
+    }
+    Clear();
+}
+
+GlyphCache::~GlyphCache() {
+}
+
+/**
+ *  @brief: drops every glyph
+ */
+void GlyphCache::Clear(void) {
+    for (int n = 0; n < this->slots; n++) {
+        entries[n].font = NULL;
+        entries[n].age = 0;
+    }
+    this->clock = 0;
+    this->hits = 0;
+    this->misses = 0;
+}
+
+/**
+ *  @brief: the glyph of ascii_char in font, in frame buffer orientation for rotate and
+ *          starting at bit shift of its first byte. a missing glyph is rendered in the
+ *          least recently used slot. returns NULL if the glyph does not fit a slot.
+ */
+const GlyphCacheEntry* GlyphCache::Fetch(sFONT* font, char ascii_char, int rotate, int shift) {
+    GlyphCacheEntry* entry = NULL;
+    int n, i, j, u, v;
+
+    for (n = 0; n < this->slots; n++) {
+        if (entries[n].font == font && entries[n].ascii_char == ascii_char &&
+            entries[n].rotate == rotate && entries[n].shift == shift) {
+            entries[n].age = ++this->clock;
+            this->hits++;
+            return &entries[n];
+        }
+        if (entry == NULL || entries[n].age < entry->age) {
+            entry = &entries[n];
+        }
+    }
+
+    int portrait = rotate == ROTATE_90 || rotate == ROTATE_270;
+    int width = portrait ? font->Height : font->Width;
+    int height = portrait ? font->Width : font->Height;
+    int row_bytes = ((shift + width - 1) >> 3) + 1;
+    int font_row_bytes = font->Width / 8 + (font->Width % 8 ? 1 : 0);
+    const unsigned char* ptr = &font->table[(ascii_char - ' ') * font->Height * font_row_bytes];
+
+    /* a glyph too big for a slot is a miss too: it is drawn without the cache every time */
+    this->misses++;
+    if (entry == NULL || width > 255 || height > 255 || row_bytes * height > this->slot_bytes) {
+        return NULL;
+    }
+    entry->font = font;
+    entry->ascii_char = ascii_char;
+    entry->rotate = rotate;
+    entry->shift = shift;
+    entry->width = width;
+    entry->height = height;
+    entry->row_bytes = row_bytes;
+    entry->age = ++this->clock;
+    memset(entry->bitmap, 0, row_bytes * height);
+    for (j = 0; j < font->Height; j++) {
+        for (i = 0; i < font->Width; i++) {
+            if (pgm_read_byte(&ptr[i / 8]) & (0x80 >> (i % 8))) {
+                /* glyph pixel i, j in the box of the rotated glyph (see Paint::MapPoint) */
+                if (rotate == ROTATE_90) {
+                    u = font->Height - 1 - j;
+                    v = i;
+                } else if (rotate == ROTATE_180) {
+                    u = font->Width - 1 - i;
+                    v = font->Height - 1 - j;
+                } else if (rotate == ROTATE_270) {
+                    u = j;
+                    v = font->Width - 1 - i;
+                } else {
+                    u = i;
+                    v = j;
+                }
+                u += shift;
+                entry->bitmap[v * row_bytes + (u >> 3)] |= 0x80 >> (u & 7);
+            }
+        }
+        ptr += font_row_bytes;
+    }
+    return entry;
+}
+
+unsigned long GlyphCache::GetHits(void) {
+    return this->hits;
+}
+
+unsigned long GlyphCache::GetMisses(void) {
+    return this->misses;
+}
+
+/* the depths built in the library */
+template class BasicPaint<1>;
+template class BasicPaint<2>;
+template class BasicPaint<4>;
+template class BasicPaint<8>;
+
+/* END OF FILE */
@@ -36,39 +36,299 @@
 // Color inverse. 1 or 0 = set or reset a bit if set a colored pixel
 #define IF_INVERT_COLOR     1
 
+// Dirty rectangles kept by a Paint, and their default merge slack (see Paint::SetDirtyMerge)
+#define DIRTY_RECTS         8
+#define DIRTY_MERGE_SLACK   2048
+
+// Nested clip rectangles of a Paint (see Paint::PushClip)
+#define CLIP_STACK_DEPTH    4
+
+// Most vertices of a polygon filled by Paint::DrawFilledPolygon
+#define POLYGON_VERTICES    32
+
+// Line ends of Paint::DrawThickLine
+#define CAP_BUTT            0
+#define CAP_SQUARE          1
+#define CAP_ROUND           2
+
+// Levels of the ordered dither fill patterns (see Paint::SetFillLevel)
+#define DITHER_LEVELS       17
+
+// Gray levels of a GrayPaint surface (4 bits per pixel)
+#define GRAY_LEVELS         16
+#define GRAY_BLACK          0
+#define GRAY_WHITE          15
+
+// Bytes of the row buffer of Paint::BlitScaled (pixels scaled at a time, / 8)
+#define SCALE_ROW_BYTES     32
+
+// Raster operations of Paint::Blit, on the frame buffer bits
+#define ROP_COPY            0
+#define ROP_OR              1
+#define ROP_AND             2
+#define ROP_XOR             3
+#define ROP_NOT_SRC         4
+#define ROP_ERASE           5
+
 #include "fonts.h"
+#include "epdfont.h"
+
+/**
+ *  A 1 bit per pixel image with the layout of a Paint buffer: rows of (width + 7) / 8 bytes,
+ *  leftmost pixel in the most significant bit. progmem != 0 if image is in PROGMEM.
+ */
+struct Bitmap {
+    const unsigned char* image;
+    int width;
+    int height;
+    int progmem;
+};
+
+int UpscaleBits(const Bitmap& src, unsigned char* dst, int factor);
 
-class Paint {
+/**
+ *  Work entry of Paint::FloodFill: a filled run x0 ... x1 of frame buffer row y,
+ *  along which row y + dy is still to be explored (x0 moves on as it is).
+ */
+struct FloodSpan {
+    int16_t x0;
+    int16_t x1;
+    int16_t y;
+    int16_t dy;
+};
+
+/**
+ *  A glyph held by a GlyphCache, in frame buffer orientation: height rows of row_bytes
+ *  bytes, the glyph starting at bit shift of the first byte of each row.
+ */
+struct GlyphCacheEntry {
+    const sFONT* font;
+    unsigned char* bitmap;
+    unsigned long age;
+    char ascii_char;
+    unsigned char rotate;
+    unsigned char shift;
+    unsigned char width;
+    unsigned char height;
+    unsigned char row_bytes;
+};
+
+/**
+ *  Optional RAM cache of glyphs for Paint (see Paint::SetGlyphCache), least recently used
+ *  out. A glyph is stored already transposed for the rotation and shifted for the bit
+ *  alignment it is drawn at, so drawing it again is a plain copy or OR of whole bytes.
+ *  The memory is given by the caller: slots entries, and slots * slot_bytes bytes of
+ *  bitmaps. A glyph takes height * row_bytes bytes; Font24 needs 72 bytes (24 rows of
+ *  3 bytes in ROTATE_0 and ROTATE_180), Font12 24 bytes. Bigger glyphs are not cached,
+ *  and count as misses every time they are drawn.
+ *  One cache can be shared by several Paint objects.
+ */
+class GlyphCache {
 public:
-    Paint(unsigned char* image, int width, int height);
-    ~Paint();
+    GlyphCache(GlyphCacheEntry* entries, unsigned char* bitmaps, int slots, int slot_bytes);
+    ~GlyphCache();
+    void Clear(void);
+    const GlyphCacheEntry* Fetch(sFONT* font, char ascii_char, int rotate, int shift);
+    unsigned long GetHits(void);
+    unsigned long GetMisses(void);
+
+private:
+    GlyphCacheEntry* entries;
+    int slots;
+    int slot_bytes;
+    unsigned long clock;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+/**
+ *  Drawing surface of Bpp bits per pixel (1, 2, 4 or 8): 8 / Bpp pixels per byte, leftmost
+ *  pixel in the most significant bits; the width is rounded up to a multiple of 8.
+ *  Every depth has the same primitives, clipping, bands and dirty rectangles: they are
+ *  written once against the pixel, span and mask accessors of the depth, resolved at
+ *  compile time. At 1 bpp (Paint) colored is a color, drawn as set by IF_INVERT_COLOR;
+ *  above, it is the pixel value, from 0 to (1 << Bpp) - 1: at 4 bpp (GrayPaint)
+ *  GRAY_BLACK (0) to GRAY_WHITE (15). Bitmaps, glyphs and fill patterns stay 1 bit per
+ *  pixel: above 1 bpp their set bits are drawn in colored, the clear bits of a fill
+ *  pattern leave the pixels as they are, and the raster operations of Blit apply to
+ *  all the bits of a pixel.
+ */
+template<int Bpp>
+class BasicPaint {
+public:
+    BasicPaint(unsigned char* image, int width, int height);
+    ~BasicPaint();
     void Clear(int colored);
     int  GetWidth(void);
     void SetWidth(int width);
     int  GetHeight(void);
     void SetHeight(int height);
+    void SetBand(int y, int rows, int frame_height);
+    int  GetBandY(void);
+    int  GetBandRows(void);
     int  GetRotate(void);
     void SetRotate(int rotate);
+    void SetGlyphCache(GlyphCache* cache);
+    int  PushClip(int x0, int y0, int x1, int y1);
+    void PopClip(void);
+    void SetFillPattern(const unsigned char* pattern);
+    void SetFillLevel(int level);
+    const unsigned char* GetFillPattern(void);
     unsigned char* GetImage(void);
+    int  GetAbsolutePixel(int x, int y);
     void DrawAbsolutePixel(int x, int y, int colored);
     void DrawPixel(int x, int y, int colored);
     void DrawCharAt(int x, int y, char ascii_char, sFONT* font, int colored);
+    void DrawCharAt(int x, int y, char ascii_char, sFONT* font, int colored, int background);
     void DrawStringAt(int x, int y, const char* text, sFONT* font, int colored);
+    void DrawStringAt(int x, int y, const char* text, sFONT* font, int colored, int background);
+    int  DrawCharAt(int x, int y, uint16_t code, const sPFONT* font, int colored);
+    int  DrawStringAt(int x, int y, const char* text, const sPFONT* font, int colored);
+    int  DrawStringAt(int x, int y, const char* text, const sPFONT* font, int colored, int background);
     void DrawLine(int x0, int y0, int x1, int y1, int colored);
+    void DrawThickLine(int x0, int y0, int x1, int y1, int thickness, int cap, int colored);
     void DrawHorizontalLine(int x, int y, int width, int colored);
     void DrawVerticalLine(int x, int y, int height, int colored);
     void DrawRectangle(int x0, int y0, int x1, int y1, int colored);
     void DrawFilledRectangle(int x0, int y0, int x1, int y1, int colored);
     void DrawCircle(int x, int y, int radius, int colored);
     void DrawFilledCircle(int x, int y, int radius, int colored);
+    void DrawEllipse(int x, int y, int x_radius, int y_radius, int colored);
+    void DrawFilledEllipse(int x, int y, int x_radius, int y_radius, int colored);
+    void DrawRoundedRectangle(int x0, int y0, int x1, int y1, int radius, int colored);
+    void DrawFilledRoundedRectangle(int x0, int y0, int x1, int y1, int radius, int colored);
+    void DrawPolygon(const int* points, int count, int colored);
+    void DrawFilledPolygon(const int* points, int count, int colored);
+    void DrawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, int colored);
+    void DrawFilledTriangle(int x0, int y0, int x1, int y1, int x2, int y2, int colored);
+    void DrawArc(int x, int y, int radius, int start_angle, int end_angle, int colored);
+    void DrawAnnulusSegment(int x, int y, int inner_radius, int outer_radius, int start_angle, int end_angle, int colored);
+    int  FloodFill(int x, int y, int colored, FloodSpan* stack, int stack_size);
+    void Blit(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y, int rop = ROP_COPY);
+    void Blit(BasicPaint<1>& src, int src_x, int src_y, int width, int height, int x, int y, int rop = ROP_COPY);
+    void BlitScaled(const Bitmap& src, int src_x, int src_y, int src_width, int src_height,
+                    int x, int y, int width, int height, int rop = ROP_COPY);
+    static int SaveBytes(int width, int height);
+    void SaveRect(int x, int y, int width, int height, unsigned char* buffer);
+    void RestoreRect(int x, int y, int width, int height, const unsigned char* buffer);
+    int  GetDirtyCount(void);
+    void GetDirtyRect(int index, int& x, int& y, int& w, int& l);
+    void ClearDirty(void);
+    void SetDirtyMerge(long slack);
 
 private:
+    enum {
+        PIXELS_PER_BYTE = 8 / Bpp,
+        PIXEL_SHIFT = Bpp == 1 ? 3 : (Bpp == 2 ? 2 : (Bpp == 4 ? 1 : 0)),
+        PIXEL_MASK = (1 << Bpp) - 1
+    };
+
+    /* bounds included */
+    struct Rect {
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+    };
+
+    typedef void (BasicPaint::*PixelFunction)(int x, int y);
+    typedef void (BasicPaint::*SpanFunction)(int x0, int x1, int y);
+    typedef void (BasicPaint::*ColumnFunction)(int x, int y0, int y1);
+    typedef void (BasicPaint::*RectFunction)(int x0, int y0, int x1, int y1);
+    typedef void (BasicPaint::*LineFunction)(int x0, int y0, int x1, int y1);
+    typedef void (BasicPaint::*GlyphFunction)(int x, int y, char ascii_char, sFONT* font);
+    typedef void (BasicPaint::*BlitFunction)(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y, int rop);
+
+    void ResetClip(void);
+    int  Ink(int colored);
+    int  Paper(int colored);
+    int  FillInk(int colored);
+    void OutlinePolygon(const int* points, int count, int ink);
+    void FillAnnulus(int x, int y, int inner_radius, int outer_radius, int start_angle, int end_angle, int ink);
+    unsigned char* AbsoluteRow(int y);
+    int  RowBytes(void);
+    static unsigned char PixelMask(int x);
+    static unsigned char LeadMask(int x);
+    static unsigned char TrailMask(int x);
+    static unsigned char ExpandBits(unsigned char bits);
+    template<int SET> unsigned char ValueByte(void);
+    void PatternByte(int n, int y, unsigned char& bits, unsigned char& mask);
+    void MarkDirty(int x0, int y0, int x1, int y1);
+    bool ClipToAbsolute(int& x0, int& y0, int& x1, int& y1);
+    void MarkAbsoluteDirty(int x0, int y0, int x1, int y1);
+    template<class ROWS> void FillShape(ROWS rows, int x0, int y0, int x1, int y1, int radius, int colored);
+    template<class ROWS> void OutlineShape(ROWS rows, int x0, int y0, int x1, int y1, int radius, int colored);
+
+    template<int R> void SelectPipeline(void);
+    template<int R> void MapPoint(int x, int y, int& abs_x, int& abs_y);
+    template<int SET> void PlotAbsolute(int x, int y);
+    template<int SET> void FillAbsoluteSpan(int x0, int x1, int y);
+    template<int SET> void FillAbsoluteColumn(int x, int y0, int y1);
+    template<int SET, int OPAQUE> void BlitCachedGlyph(const GlyphCacheEntry* entry, int x, int y);
+    template<int SET, int OPAQUE> void BlitAbsoluteRow(const unsigned char* bits, int ax, int x0, int x1, int y);
+    template<int R, int SET> void PlotAt(int x, int y);
+    template<int R, int SET> void PixelAt(int x, int y);
+    template<int R, int SET> void SpanAt(int x0, int x1, int y);
+    template<int R, int SET> void ColumnAt(int x, int y0, int y1);
+    template<int R, int SET> void RectAt(int x0, int y0, int x1, int y1);
+    template<int R, int SET> void LineAt(int x0, int y0, int x1, int y1);
+    template<int R> void BlitAt(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y, int rop);
+    template<int R, int ROP> void BlitRop(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y);
+    template<int ROP, int PGM> void BlitAbsoluteRows(const Bitmap& src, int src_x, int src_y, int width, int height, int x, int y);
+    template<int R, int SET, int OPAQUE> void GlyphAt(int x, int y, char ascii_char, sFONT* font);
+
     unsigned char* image;
     int width;
     int height;
     int rotate;
+    /* absolute rows held by the frame buffer (all of them unless banded, see SetBand) */
+    int band_y;
+    int band_rows;
+    /* logical clip rectangle, bounds included: every primitive is clipped to it once,
+       then drawn by unchecked loops. It is the whole surface, or the band (see ResetClip),
+       intersected with the rectangles pushed by PushClip */
+    int clip_x0;
+    int clip_y0;
+    int clip_x1;
+    int clip_y1;
+    Rect clip_stack[CLIP_STACK_DEPTH];
+    int clip_depth;
+    GlyphCache* glyph_cache;
+    /* absolute areas written since ClearDirty, x bounds aligned to bytes */
+    Rect dirty[DIRTY_RECTS];
+    int dirty_count;
+    long dirty_slack;
+    /* pixel values of the routines indexed 1 (ink) and 0 (paper) above 1 bpp, and both
+       repeated over a byte (see Ink, Paper) */
+    int ink_value;
+    unsigned char ink_byte;
+    unsigned char paper_byte;
+    /* fill pattern (see SetFillPattern), and its rows for the fill being drawn: at 1 bpp
+       the frame buffer bits, above the mask of the pixels taking the ink, Bpp bytes a row
+       (see FillInk) */
+    unsigned char fill_pattern[8];
+    unsigned char pattern_bits[8 * Bpp];
+    bool fill_patterned;
+    /* routines specialised for the current rotation, indexed by the pixel value (see SetRotate);
+       the third ones draw the fill pattern */
+    PixelFunction plot_ops[3];
+    PixelFunction pixel_ops[3];
+    SpanFunction span_ops[3];
+    ColumnFunction column_ops[3];
+    RectFunction rect_ops[3];
+    LineFunction line_ops[3];
+    GlyphFunction glyph_ops[2];
+    GlyphFunction opaque_glyph_ops[2];
+    BlitFunction blit_op;
 };
 
+/* the black and white frame buffer surface */
+typedef BasicPaint<1> Paint;
+
+/* 4 bits per pixel surface, drawn on the display with Epd::drawGrayShades(GrayPaint&);
+   a 400x300 surface needs 60000 bytes */
+typedef BasicPaint<4> GrayPaint;
+
 #endif
 
 /* END OF FILE */
@@ -0,0 +1,307 @@
+/**
+ *  @filename   :   epdshades.cpp
+ *  @brief      :   Shade-plane generation for the gray shade pipeline
+ *  @author     :   Deep Tronix
+ *
+ *  Copyright (C) Deep Tronix     2021
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documnetation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to  whom the Software is
+ * furished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS OR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "epdshades.h"
+#include "epdpaint.h"		// IF_INVERT_COLOR, for the overlay masks
+
+/**
+ *  @brief: fixed threshold of a shade pass: pixels darker than it are black in that pass
+ */
+uint8_t shadeThreshold(uint8_t shade){
+	return 255 - (255*(shade+1))/SHADES;
+}
+
+/**
+ *  @brief: reads 8 horizontal pixels of the image on the 8 bit (0-255) scale, with the overlay
+ *          applied. A NULL buffer reads as black.
+ *  @param: byte_index: index of the group of pixels, i.e. of pixels 8*byte_index ... 8*byte_index + 7
+ *          values: output, 8 values
+ */
+void shadePixels(const ShadeImage& image, uint32_t byte_index, uint8_t* values){
+	if(image.buffer == NULL){
+		memset(values, 0, 8);
+	}
+	else if(image.bpp == 4){
+		const uint8_t* src = &image.buffer[byte_index * 4];
+		for(uint8_t off = 0; off < 4; off++){
+			values[2 * off] = (src[off] >> 4) * 17;
+			values[2 * off + 1] = (src[off] & 0x0F) * 17;
+		}
+	}
+	else{
+		memcpy(values, &image.buffer[byte_index * 8], 8);
+	}
+
+	if(image.overlay != NULL){
+		uint8_t mask = IF_INVERT_COLOR ? image.overlay[byte_index] : ~image.overlay[byte_index];
+		for(uint8_t off = 0; off < 8; off++){
+			if(mask & (0x80 >> off))  values[off] = image.overlay_gray;
+		}
+	}
+}
+
+/**
+ *  @brief: builds one byte (8 horizontal pixels) of the threshold plane sent in a shade pass.
+ *          A bit is set (white) when the pixel is at least as bright as "thresh",
+ *          reset (black) otherwise.
+ *  @param: byte_index: index of the output byte, i.e. of pixels 8*byte_index ... 8*byte_index + 7
+ *          thresh: threshold on the 8 bit (0-255) scale, also for 4 bpp sources
+ */
+uint8_t shadePlaneByte(const ShadeImage& image, uint32_t byte_index, uint8_t thresh){
+	uint8_t values[8];
+	uint8_t output = 0;
+	shadePixels(image, byte_index, values);
+	for(uint8_t off = 0; off < 8; off++){
+		output <<= 1;
+		output |= (values[off] >= thresh)?  0x01 : 0x00;
+	}
+	return output;
+}
+
+/**
+ *  @brief: nominal tone (0-255) of a pixel which is black in the first "level" shade passes
+ *          (level 0 is white, level SHADES - 1 is black)
+ */
+uint8_t shadeTone(uint8_t level){
+	return 255 - (255*level)/(SHADES-1);
+}
+
+/**
+ *  @brief: picks the physical levels to use for this image, and the thresholds that map every
+ *          pixel to the closest one. All the subsets of levels are tried (white is always
+ *          available): the chosen one needs the fewest passes while keeping the RMS error within
+ *          max_rms, the lowest error breaking ties. If no subset meets max_rms, the most
+ *          accurate one is used.
+ *  @param: hist: histogram of the 8 bit pixel values, total: number of pixels
+ *          thresh: output, threshold of each shade pass (0 for the unused, empty, passes)
+ */
+static void selectShadeThresholds(const uint32_t* hist, uint32_t total, uint8_t max_rms, uint8_t* thresh){
+	uint64_t limit = (uint64_t)max_rms * max_rms * total;
+	uint64_t best_err = 0, fallback_err = 0;
+	uint8_t best_passes = 255;
+	uint16_t best_mask = 0, fallback_mask = 0;
+	bool fallback_set = false;
+
+	for(uint16_t mask = 0; mask < (1 << (SHADES - 1)); mask++){
+		uint8_t levels[SHADES];		// selected levels, from white to black
+		uint8_t bounds[SHADES];		// pixels below bounds[i] are mapped to levels[i] or darker
+		uint8_t cnt = 0;
+		levels[cnt++] = 0;
+		for(uint8_t level = 1; level < SHADES; level++){
+			if(mask & (1 << (level - 1))){
+				bounds[cnt] = (shadeTone(levels[cnt - 1]) + shadeTone(level) + 1) / 2;
+				levels[cnt++] = level;
+			}
+		}
+
+		uint64_t err = 0;
+		uint8_t passes = 0, i = 0;
+		uint32_t level_px = 0;
+		for(int v = 255; v >= 0; v--){
+			while(i + 1 < cnt  &&  v < bounds[i + 1]){
+				if(i > 0  &&  level_px)  passes++;
+				i++;
+				level_px = 0;
+			}
+			if(hist[v]){
+				int d = v - shadeTone(levels[i]);
+				err += (uint64_t)hist[v] * (d * d);
+				level_px += hist[v];
+			}
+		}
+		if(i > 0  &&  level_px)  passes++;
+		if(passes == 0)  passes = 1;
+
+		if(!fallback_set  ||  err < fallback_err){
+			fallback_set = true;
+			fallback_err = err;
+			fallback_mask = mask;
+		}
+		if(err <= limit  &&  (passes < best_passes  ||  (passes == best_passes  &&  err < best_err))){
+			best_passes = passes;
+			best_err = err;
+			best_mask = mask;
+		}
+	}
+	if(best_passes == 255){
+		best_mask = fallback_mask;
+	}
+
+	// shade pass k draws black the pixels mapped to a level beyond k
+	uint8_t prev_level = 0;
+	for(uint8_t shade = 0; shade < (SHADES - 1); shade++){
+		thresh[shade] = 0;
+	}
+	for(uint8_t level = 1; level < SHADES; level++){
+		if(best_mask & (1 << (level - 1))){
+			uint8_t bound = (shadeTone(prev_level) + shadeTone(level) + 1) / 2;
+			for(uint8_t shade = prev_level; shade < level; shade++){
+				thresh[shade] = bound;
+			}
+			prev_level = level;
+		}
+	}
+}
+
+/**
+ *  @brief: scans the image (overlay included) once, building its histogram and the darkest value of every row,
+ *          then schedules the shade passes.
+ *          The planes are nested (a pixel black at a threshold is black at every higher one), so:
+ *          - plane "shade" equals plane "shade - 1" when no pixel lies between their thresholds;
+ *            the two passes are merged, the refresh of the merged pass carrying both drives;
+ *          - once a plane is empty, all the following ones are, and those passes are dropped.
+ *          The first pass always uploads the full image, so that the previous content is erased.
+ *          Every other pass uploads the rows where the previous pass had black pixels: those
+ *          contain all of its own black pixels and the pixels that turn back white.
+ *  @param: max_rms: 0 keeps the fixed thresholds (see shadeThreshold). Otherwise the thresholds
+ *          are chosen from the histogram, using as few passes as possible while the RMS error
+ *          against the nominal tones (see shadeTone) stays within max_rms (0-255 scale).
+ */
+void planShades(const ShadeImage& image, ShadePlan& plan, uint8_t max_rms){
+	uint32_t hist[256];
+	uint8_t thresh[SHADES - 1];
+	uint8_t* row_min = (uint8_t*)malloc(image.height);		// if NULL, every pass uploads the full image
+	uint8_t shade;
+
+	memset(hist, 0, sizeof(hist));
+	for(int row = 0; row < image.height; row++){
+		uint8_t darkest = 255;
+		uint8_t values[8];
+		for(int col = 0; col < image.width / 8; col++){
+			shadePixels(image, (uint32_t)row * (image.width / 8) + col, values);
+			for(uint8_t off = 0; off < 8; off++){
+				hist[values[off]]++;
+				if(values[off] < darkest)  darkest = values[off];
+			}
+		}
+		if(row_min != NULL)  row_min[row] = darkest;
+	}
+
+	if(max_rms){
+		selectShadeThresholds(hist, (uint32_t)image.width * image.height, max_rms, thresh);
+	}
+	else{
+		for(shade = 0; shade < (SHADES - 1); shade++){
+			thresh[shade] = shadeThreshold(shade);
+		}
+	}
+
+	plan.passes = 0;
+	for(shade = 0; shade < (SHADES - 1); shade++){
+		uint32_t below = 0, between = 0;		// pixels black in this plane, and only in the previous one
+		for(int v = 0; v < 256; v++){
+			if(v < thresh[shade])  below += hist[v];
+			else if(shade > 0  &&  v < thresh[shade - 1])  between += hist[v];
+		}
+		if(shade > 0){
+			if(below == 0){
+				break;		// empty plane: so are the remaining ones
+			}
+			if(between == 0){
+				plan.last_shade[plan.passes - 1] = shade;
+				continue;
+			}
+		}
+		uint8_t p = plan.passes++;
+		plan.thresh[p] = thresh[shade];
+		plan.first_shade[p] = shade;
+		plan.last_shade[p] = shade;
+		plan.row_start[p] = 0;
+		plan.row_end[p] = image.height - 1;
+		if(p > 0  &&  row_min != NULL){
+			uint8_t prev_thresh = plan.thresh[p - 1];
+			plan.row_start[p] = -1;
+			for(int row = 0; row < image.height; row++){
+				if(row_min[row] < prev_thresh){
+					if(plan.row_start[p] < 0)  plan.row_start[p] = row;
+					plan.row_end[p] = row;
+				}
+			}
+		}
+	}
+
+	free(row_min);
+}
+
+/**
+ *  @brief: error diffusion (serpentine Floyd-Steinberg) of an 8 bit image down to "levels"
+ *          physical gray levels, spread evenly between white and black. Every pixel is replaced
+ *          by the nominal tone of its level (see shadeTone), which the fixed thresholds of the
+ *          shade pipeline map back to that same level: drawGrayShades then merges the unused
+ *          levels away, and renders the image in levels - 1 passes.
+ *  @param: buffer: 8 bit image (0 = black, 255 = white), modified in place
+ *          levels: 2 ... SHADES
+ *  @return: the most passes the result can need, 0 if the work buffer could not be allocated
+ */
+uint8_t ditherShades(uint8_t* buffer, int w, int l, uint8_t levels){
+	if(levels < 2)  levels = 2;
+	if(levels > SHADES)  levels = SHADES;
+
+	uint8_t tones[SHADES];
+	for(uint8_t j = 0; j < levels; j++){
+		tones[j] = shadeTone(((SHADES - 1) * j + (levels - 1) / 2) / (levels - 1));
+	}
+
+	int16_t* err = (int16_t*)malloc(2 * (w + 2) * sizeof(int16_t));		// current and next row, 1 pixel margin on both sides
+	if(err == NULL)  return 0;
+	int16_t* curr = err + 1;
+	int16_t* next = err + (w + 2) + 1;
+	memset(err, 0, 2 * (w + 2) * sizeof(int16_t));
+
+	for(int row = 0; row < l; row++){
+		bool ltr = !(row & 1);
+		int dir = ltr ? 1 : -1;
+		uint8_t* src = &buffer[(uint32_t)row * w];
+		for(int k = 0; k < w; k++){
+			int col = ltr ? k : (w - 1 - k);
+			int value = src[col] + curr[col] / 16;
+
+			uint8_t best = 0;		// closest tone; tones[] goes from white to black
+			for(uint8_t j = 1; j < levels; j++){
+				int d_best = value - tones[best], d_j = value - tones[j];
+				if(d_j * d_j < d_best * d_best)  best = j;
+			}
+			src[col] = tones[best];
+
+			int e = value - tones[best];		// the 1/16 scale is applied when reading
+			curr[col + dir] += e * 7;
+			next[col - dir] += e * 3;
+			next[col]       += e * 5;
+			next[col + dir] += e * 1;
+		}
+		int16_t* tmp = curr;
+		curr = next;
+		next = tmp;
+		memset(next - 1, 0, (w + 2) * sizeof(int16_t));
+	}
+
+	free(err);
+	return levels - 1;
+}
+
+/* END OF FILE */
@@ -0,0 +1,79 @@
+/**
+ *  @filename   :   epdshades.h
+ *  @brief      :   Header file for epdshades.cpp
+ *  @author     :   Deep Tronix
+ *
+ *  Copyright (C) Deep Tronix     2021
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documnetation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to  whom the Software is
+ * furished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS OR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef EPDSHADES_H
+#define EPDSHADES_H
+
+#include <stdint.h>
+
+// Number of gray shades produced by the shade pipeline (see Epd::drawGrayShades).
+// Altering it requires editing the SetLutShades B2B formula and the shade LUTs.
+#define SHADES              8
+
+/**
+ *  Source image for the shade-plane generator.
+ *  bpp = 8: one byte per pixel, 0 = black, 255 = white.
+ *  bpp = 4: two pixels per byte (left pixel in the high nibble), 0 = black, 15 = white;
+ *           this is the layout written by GrayPaint.
+ *  The width must be a multiple of 8.
+ *  overlay (optional, may be NULL): 1 bpp mask with the layout of a Paint buffer of the same
+ *  size; its colored pixels are drawn in overlay_gray (0-255) instead of the image, in the
+ *  same passes. This renders crisp text or lines over a gray picture without an extra refresh.
+ */
+struct ShadeImage {
+    const uint8_t* buffer;
+    int width;
+    int height;
+    uint8_t bpp;
+    const uint8_t* overlay;
+    uint8_t overlay_gray;
+};
+
+/**
+ *  Pass schedule of a gray shade render, built by planShades().
+ *  Pass p uploads the plane built with thresh[p] and refreshes it with the drive of the shades
+ *  first_shade[p] ... last_shade[p] (consecutive identical planes are merged in a single pass,
+ *  trailing empty planes are dropped). Only the rows row_start[p] ... row_end[p] are uploaded.
+ */
+struct ShadePlan {
+    uint8_t passes;
+    uint8_t thresh[SHADES - 1];
+    uint8_t first_shade[SHADES - 1];
+    uint8_t last_shade[SHADES - 1];
+    int row_start[SHADES - 1];
+    int row_end[SHADES - 1];
+};
+
+uint8_t shadeThreshold(uint8_t shade);
+uint8_t shadeTone(uint8_t level);
+void shadePixels(const ShadeImage& image, uint32_t byte_index, uint8_t* values);
+uint8_t shadePlaneByte(const ShadeImage& image, uint32_t byte_index, uint8_t thresh);
+void planShades(const ShadeImage& image, ShadePlan& plan, uint8_t max_rms = 0);
+uint8_t ditherShades(uint8_t* buffer, int w, int l, uint8_t levels);
+
+#endif
+
+/* END OF FILE */
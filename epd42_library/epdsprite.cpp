@@ -0,0 +1,233 @@
+/**
+ *  @filename   :   epdsprite.cpp
+ *  @brief      :   Sprites over a Paint, with background restore
+ *  @author     :   Deep Tronix
+ *
+ *  Copyright (C) Deep Tronix     2021
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documnetation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to  whom the Software is
+ * furished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS OR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stddef.h>
+#include "epdsprite.h"
+
+/**
+ *  @brief: true if the areas x, y, w x l overlap
+ */
+static bool Overlap(int ax, int ay, int aw, int al, int bx, int by, int bw, int bl) {
+    return ax < bx + bw && bx < ax + aw && ay < by + bl && by < ay + al;
+}
+
+SpriteLayer::SpriteLayer(Paint& paint, Sprite** sprites, int capacity) : paint(paint) {
+    this->sprites = sprites;
+    this->capacity = capacity;
+    this->count = 0;
+}
+
+SpriteLayer::~SpriteLayer() {
+}
+
+/**
+ *  @brief: adds a sprite at x, y, hidden (see Show); sprites of the same z are kept in the
+ *          order they are added, the last one on top. returns 0 if the list is full.
+ */
+int SpriteLayer::Add(Sprite& sprite, int x, int y, int z) {
+    int n;
+    if (this->count >= this->capacity) {
+        return 0;
+    }
+    sprite.x = x;
+    sprite.y = y;
+    sprite.z = z;
+    sprite.visible = 0;
+    sprite.drawn = 0;
+    sprite.lifted = 0;
+    for (n = this->count; n > 0 && sprites[n - 1]->z > z; n--) {
+        sprites[n] = sprites[n - 1];
+    }
+    sprites[n] = &sprite;
+    this->count++;
+    return 1;
+}
+
+/**
+ *  @brief: takes a sprite off the screen and out of the list
+ */
+void SpriteLayer::Remove(Sprite& sprite) {
+    int index = IndexOf(sprite);
+    int x, y, w, l;
+    if (index < 0) {
+        return;
+    }
+    Update(index, sprite.x, sprite.y, 0, x, y, w, l);
+    for (this->count--; index < this->count; index++) {
+        sprites[index] = sprites[index + 1];
+    }
+}
+
+/**
+ *  @brief: moves a sprite to x, y. changed_* get the logical area to refresh: the union
+ *          of the old and new areas of the sprite (w and l are 0 if nothing changed)
+ */
+void SpriteLayer::Move(Sprite& sprite, int x, int y, int& changed_x, int& changed_y, int& changed_w, int& changed_l) {
+    int index = IndexOf(sprite);
+    changed_w = 0;
+    changed_l = 0;
+    if (index >= 0) {
+        Update(index, x, y, sprite.visible, changed_x, changed_y, changed_w, changed_l);
+    }
+}
+
+/**
+ *  @brief: shows (visible != 0) or hides a sprite; changed_* as for Move
+ */
+void SpriteLayer::Show(Sprite& sprite, int visible, int& changed_x, int& changed_y, int& changed_w, int& changed_l) {
+    int index = IndexOf(sprite);
+    changed_w = 0;
+    changed_l = 0;
+    if (index >= 0) {
+        Update(index, sprite.x, sprite.y, visible, changed_x, changed_y, changed_w, changed_l);
+    }
+}
+
+/**
+ *  @brief: puts back the frame buffer under every sprite, top first
+ */
+void SpriteLayer::Erase(void) {
+    for (int n = this->count - 1; n >= 0; n--) {
+        if (sprites[n]->drawn) {
+            EraseSprite(*sprites[n]);
+        }
+    }
+}
+
+/**
+ *  @brief: draws every visible sprite again, bottom first (after Erase)
+ */
+void SpriteLayer::Draw(void) {
+    for (int n = 0; n < this->count; n++) {
+        if (sprites[n]->visible && !sprites[n]->drawn) {
+            DrawSprite(*sprites[n]);
+        }
+    }
+}
+
+int SpriteLayer::IndexOf(Sprite& sprite) {
+    for (int n = 0; n < this->count; n++) {
+        if (sprites[n] == &sprite) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+/**
+ *  @brief: the sprite at index goes to x, y, visible or not. The sprites above it that
+ *          overlap its old or new area, or another sprite lifted this way, are erased
+ *          (top first) together with it, and drawn again after it (bottom first): the
+ *          frame buffer saved under each of them stays what is below it.
+ */
+void SpriteLayer::Update(int index, int x, int y, int visible, int& changed_x, int& changed_y, int& changed_w, int& changed_l) {
+    Sprite& sprite = *sprites[index];
+    int w = sprite.image.width;
+    int l = sprite.image.height;
+    int old_w = sprite.drawn ? w : 0;
+    int new_w = visible ? w : 0;
+    int old_x = sprite.drawn_x;
+    int old_y = sprite.drawn_y;
+    int n, m, x0, y0, x1, y1;
+
+    for (n = index + 1; n < this->count; n++) {
+        Sprite& above = *sprites[n];
+        above.lifted = 0;
+        if (!above.drawn) {
+            continue;
+        }
+        if (Overlap(above.drawn_x, above.drawn_y, above.image.width, above.image.height,
+                    old_x, old_y, old_w, l) ||
+            Overlap(above.drawn_x, above.drawn_y, above.image.width, above.image.height, x, y, new_w, l)) {
+            above.lifted = 1;
+            continue;
+        }
+        for (m = index + 1; m < n; m++) {
+            if (sprites[m]->lifted &&
+                Overlap(above.drawn_x, above.drawn_y, above.image.width, above.image.height,
+                        sprites[m]->drawn_x, sprites[m]->drawn_y, sprites[m]->image.width, sprites[m]->image.height)) {
+                above.lifted = 1;
+                break;
+            }
+        }
+    }
+
+    for (n = this->count - 1; n > index; n--) {
+        if (sprites[n]->lifted) {
+            EraseSprite(*sprites[n]);
+        }
+    }
+    if (sprite.drawn) {
+        EraseSprite(sprite);
+    }
+    sprite.x = x;
+    sprite.y = y;
+    sprite.visible = visible;
+    if (visible) {
+        DrawSprite(sprite);
+    }
+    for (n = index + 1; n < this->count; n++) {
+        if (sprites[n]->lifted) {
+            DrawSprite(*sprites[n]);
+            sprites[n]->lifted = 0;
+        }
+    }
+
+    /* union of the old and new areas */
+    if (old_w == 0 && new_w == 0) {
+        return;
+    }
+    x0 = new_w == 0 || (old_w != 0 && old_x < x) ? old_x : x;
+    y0 = new_w == 0 || (old_w != 0 && old_y < y) ? old_y : y;
+    x1 = new_w == 0 || (old_w != 0 && old_x > x) ? old_x : x;
+    y1 = new_w == 0 || (old_w != 0 && old_y > y) ? old_y : y;
+    changed_x = x0;
+    changed_y = y0;
+    changed_w = x1 - x0 + w;
+    changed_l = y1 - y0 + l;
+}
+
+void SpriteLayer::DrawSprite(Sprite& sprite) {
+    int w = sprite.image.width;
+    int l = sprite.image.height;
+    paint.SaveRect(sprite.x, sprite.y, w, l, sprite.under);
+    if (sprite.mask.image != NULL) {
+        paint.Blit(sprite.mask, 0, 0, w, l, sprite.x, sprite.y, ROP_ERASE);
+        paint.Blit(sprite.image, 0, 0, w, l, sprite.x, sprite.y, ROP_OR);
+    } else {
+        paint.Blit(sprite.image, 0, 0, w, l, sprite.x, sprite.y, ROP_COPY);
+    }
+    sprite.drawn = 1;
+    sprite.drawn_x = sprite.x;
+    sprite.drawn_y = sprite.y;
+}
+
+void SpriteLayer::EraseSprite(Sprite& sprite) {
+    paint.RestoreRect(sprite.drawn_x, sprite.drawn_y, sprite.image.width, sprite.image.height, sprite.under);
+    sprite.drawn = 0;
+}
+
+/* END OF FILE */
@@ -0,0 +1,88 @@
+/**
+ *  @filename   :   epdsprite.h
+ *  @brief      :   Header file for epdsprite.cpp
+ *  @author     :   Deep Tronix
+ *
+ *  Copyright (C) Deep Tronix     2021
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documnetation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to  whom the Software is
+ * furished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS OR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef EPDSPRITE_H
+#define EPDSPRITE_H
+
+#include "epdpaint.h"
+
+/**
+ *  A sprite: image and mask are 1 bit per pixel bitmaps of the same size (RAM or PROGMEM,
+ *  see Bitmap), in frame buffer bits. Where the mask is set the image replaces the frame
+ *  buffer, elsewhere the frame buffer shows through; image bits outside the mask must be
+ *  clear. A mask with a NULL image makes the whole sprite opaque.
+ *  under holds the frame buffer below the sprite while it is shown: Paint::SaveBytes(width,
+ *  height) bytes, given by the caller. Sprites of higher z are drawn over lower ones.
+ *  The other members are kept by the SpriteLayer.
+ */
+struct Sprite {
+    Bitmap image;
+    Bitmap mask;
+    unsigned char* under;
+    int z;
+    int x;
+    int y;
+    int visible;
+    int drawn;
+    int drawn_x;
+    int drawn_y;
+    int lifted;
+};
+
+/**
+ *  Sprites over the content of a Paint (cursors, markers on a map...). Moving a sprite puts
+ *  back the frame buffer under its old position and draws it at the new one, with the
+ *  sprites it overlaps kept in their z order; only the sprites involved are touched.
+ *  The changed area is returned, and is in the Paint dirty rectangles as well, for a partial
+ *  refresh. Before drawing on the Paint under the sprites, Erase them, then Draw them back.
+ *  The list of sprites is given by the caller: room for capacity pointers.
+ */
+class SpriteLayer {
+public:
+    SpriteLayer(Paint& paint, Sprite** sprites, int capacity);
+    ~SpriteLayer();
+    int  Add(Sprite& sprite, int x, int y, int z);
+    void Remove(Sprite& sprite);
+    void Move(Sprite& sprite, int x, int y, int& changed_x, int& changed_y, int& changed_w, int& changed_l);
+    void Show(Sprite& sprite, int visible, int& changed_x, int& changed_y, int& changed_w, int& changed_l);
+    void Erase(void);
+    void Draw(void);
+
+private:
+    int  IndexOf(Sprite& sprite);
+    void Update(int index, int x, int y, int visible, int& changed_x, int& changed_y, int& changed_w, int& changed_l);
+    void DrawSprite(Sprite& sprite);
+    void EraseSprite(Sprite& sprite);
+
+    Paint& paint;
+    Sprite** sprites;
+    int capacity;
+    int count;
+};
+
+#endif
+
+/* END OF FILE */
@@ -0,0 +1,249 @@
+/*
+ *  Host converter from BDF fonts to the proportional font format of epdfont.h (no Arduino needed).
+ *  Each glyph is cropped to its ink, then stored raw (its pixels packed 8 per byte, rows not
+ *  padded) or run-length encoded (run lengths in nibbles); by default the smaller of the two
+ *  is kept for the whole font.
+ *  TrueType fonts can be rasterised to BDF first at the wanted size, e.g. with otf2bdf or FontForge:
+ *    otf2bdf -p 16 -r 72 DejaVuSans.ttf -o dejavu16.bdf
+ *
+ *  Build and run from this folder:
+ *    g++ -O2 font_converter.cpp -o font_converter
+ *    ./font_converter [-raw | -rle] [-range 32-126]... FontDejaVu16 dejavu16.bdf > FontDejaVu16.c
+ *  Only the characters of the ranges (32-126 if none is given) that the BDF file has are kept,
+ *  e.g. for ASCII, Latin-1 and Cyrillic: -range 32-126 -range 0xA0-0xFF -range 0x400-0x45F
+ *  then add FontDejaVu16.c to the sketch and declare it with: extern "C" sPFONT FontDejaVu16;
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+struct Glyph {
+  int code;
+  int advance;
+  int width, height;      // bitmap box
+  int x_offset, y_top;    // left of the box from the pen, top of the box above the baseline
+  std::vector<unsigned char> pixels;  // width * height, one per pixel
+};
+
+struct Range {
+  int first, last;
+};
+
+const int max_code = 0xFFFF;
+const int max_ranges = 64;
+
+
+bool compareCodes(const Glyph& a, const Glyph& b){
+  return a.code < b.code;
+}
+
+// Reads the glyphs of a BDF file within the ranges, in the order of their code points.
+// Returns false if the file cannot be read.
+bool readBdf(const char* path, const Range* ranges, int range_count, std::vector<Glyph>& glyphs, int& ascent, int& descent){
+  FILE* f = fopen(path, "r");
+  if(!f)  return false;
+  char line[1024];
+  Glyph glyph;
+  int code = -1, row = -1;
+  ascent = descent = 0;
+  glyphs.clear();
+  while(fgets(line, sizeof line, f)){
+    if(row >= 0){
+      if(!strncmp(line, "ENDCHAR", 7)){
+        for(int n = 0; n < range_count; n++){
+          if(code >= ranges[n].first  &&  code <= ranges[n].last){
+            glyph.code = code;
+            glyphs.push_back(glyph);
+            break;
+          }
+        }
+        row = -1;
+        continue;
+      }
+      if(row < glyph.height){
+        for(int x = 0; x < glyph.width; x++){
+          char digit[2] = {line[x / 4], 0};
+          int nibble = (int)strtol(digit, NULL, 16);
+          glyph.pixels[row * glyph.width + x] = (nibble >> (3 - x % 4)) & 1;
+        }
+      }
+      row++;
+    }
+    else if(!strncmp(line, "FONT_ASCENT ", 12))  ascent = atoi(line + 12);
+    else if(!strncmp(line, "FONT_DESCENT ", 13))  descent = atoi(line + 13);
+    else if(!strncmp(line, "STARTCHAR", 9)){
+      glyph = Glyph();
+      code = -1;
+    }
+    else if(!strncmp(line, "ENCODING ", 9))  code = atoi(line + 9);
+    else if(!strncmp(line, "DWIDTH ", 7))  glyph.advance = atoi(line + 7);
+    else if(!strncmp(line, "BBX ", 4)){
+      int y_offset;
+      sscanf(line + 4, "%d %d %d %d", &glyph.width, &glyph.height, &glyph.x_offset, &y_offset);
+      glyph.y_top = y_offset + glyph.height;
+      glyph.pixels.assign(glyph.width * glyph.height, 0);
+    }
+    else if(!strncmp(line, "BITMAP", 6))  row = 0;
+  }
+  fclose(f);
+  std::sort(glyphs.begin(), glyphs.end(), compareCodes);
+  return true;
+}
+
+// Shrinks the bitmap box of a glyph to its ink (an empty glyph gets an empty box).
+void crop(Glyph& glyph){
+  int x0 = glyph.width, y0 = glyph.height, x1 = -1, y1 = -1;
+  for(int y = 0; y < glyph.height; y++){
+    for(int x = 0; x < glyph.width; x++){
+      if(!glyph.pixels[y * glyph.width + x])  continue;
+      if(x < x0)  x0 = x;
+      if(x > x1)  x1 = x;
+      if(y < y0)  y0 = y;
+      if(y > y1)  y1 = y;
+    }
+  }
+  if(x1 < 0){
+    glyph.width = glyph.height = 0;
+    glyph.pixels.clear();
+    return;
+  }
+  std::vector<unsigned char> pixels;
+  for(int y = y0; y <= y1; y++){
+    for(int x = x0; x <= x1; x++)  pixels.push_back(glyph.pixels[y * glyph.width + x]);
+  }
+  glyph.x_offset += x0;
+  glyph.y_top -= y0;
+  glyph.width = x1 - x0 + 1;
+  glyph.height = y1 - y0 + 1;
+  glyph.pixels = pixels;
+}
+
+// Pixels packed 8 per byte, leftmost in the most significant bit, rows not padded.
+void encodeRaw(const Glyph& glyph, std::vector<unsigned char>& out){
+  int count = glyph.width * glyph.height;
+  for(int n = 0; n < count; n += 8){
+    unsigned char value = 0;
+    for(int b = 0; b < 8  &&  n + b < count; b++)  value |= glyph.pixels[n + b] << (7 - b);
+    out.push_back(value);
+  }
+}
+
+// Lengths of the runs of identical pixels, a nibble each: the runs alternate from a run of
+// 0 pixels, except after a length of 15, which the next nibble continues.
+void encodeRle(const Glyph& glyph, std::vector<unsigned char>& out){
+  std::vector<unsigned char> nibbles;
+  int count = glyph.width * glyph.height;
+  unsigned char value = 0;
+  for(int n = 0; n < count; value ^= 1){
+    int run = 0;
+    while(n + run < count  &&  glyph.pixels[n + run] == value)  run++;
+    n += run;
+    for(; run >= 15; run -= 15)  nibbles.push_back(15);
+    nibbles.push_back(run);
+  }
+  for(size_t n = 0; n < nibbles.size(); n += 2){
+    out.push_back((nibbles[n] << 4) | (n + 1 < nibbles.size() ? nibbles[n + 1] : 0));
+  }
+}
+
+int main(int argc, char** argv){
+  int mode = -1;   // -1: the smaller encoding
+  Range ranges[max_ranges] = {{32, 126}};
+  int range_count = 0;
+  bool valid = true;
+  int arg = 1;
+  for(; arg < argc  &&  argv[arg][0] == '-'; arg++){
+    if(!strcmp(argv[arg], "-raw"))  mode = 0;
+    else if(!strcmp(argv[arg], "-rle"))  mode = 1;
+    else if(!strcmp(argv[arg], "-range")  &&  arg + 1 < argc  &&  range_count < max_ranges){
+      // first-last, decimal or 0x hexadecimal, or a single code point
+      char* end;
+      Range& range = ranges[range_count++];
+      range.first = range.last = (int)strtol(argv[++arg], &end, 0);
+      if(*end == '-')  range.last = (int)strtol(end + 1, &end, 0);
+      valid = valid  &&  *end == 0  &&  range.first >= 0  &&  range.last <= max_code  &&  range.first <= range.last;
+    }
+    else  break;
+  }
+  if(argc - arg != 2  ||  !valid){
+    fprintf(stderr, "usage: %s [-raw | -rle] [-range first-last]... name font.bdf > name.c\n", argv[0]);
+    return 1;
+  }
+  if(range_count == 0)  range_count = 1;
+  const char* name = argv[arg];
+  std::vector<Glyph> glyphs;
+  int ascent, descent;
+  if(!readBdf(argv[arg + 1], ranges, range_count, glyphs, ascent, descent)){
+    fprintf(stderr, "cannot read %s\n", argv[arg + 1]);
+    return 1;
+  }
+  if(glyphs.empty()){
+    fprintf(stderr, "no character of %s in the ranges\n", argv[arg + 1]);
+    return 1;
+  }
+
+  // a code point the BDF file holds several times (repeated ENCODING) is kept once; the glyphs are sorted by code point
+  for(size_t n = 1; n < glyphs.size(); n++){
+    if(glyphs[n].code == glyphs[n - 1].code)  glyphs.erase(glyphs.begin() + n--);
+  }
+
+  // the line reaches the highest and the lowest glyph
+  for(size_t n = 0; n < glyphs.size(); n++){
+    crop(glyphs[n]);
+    if(glyphs[n].height == 0)  continue;
+    if(glyphs[n].y_top > ascent)  ascent = glyphs[n].y_top;
+    if(glyphs[n].height - glyphs[n].y_top > descent)  descent = glyphs[n].height - glyphs[n].y_top;
+  }
+  std::vector<unsigned char> raw, rle;
+  for(size_t n = 0; n < glyphs.size(); n++){
+    encodeRaw(glyphs[n], raw);
+    encodeRle(glyphs[n], rle);
+  }
+  if(mode < 0)  mode = rle.size() < raw.size() ? 1 : 0;
+
+  // consecutive code points make a range of the index
+  std::vector<Range> index;
+  std::vector<int> index_glyph;
+  for(size_t n = 0; n < glyphs.size(); n++){
+    if(index.empty()  ||  glyphs[n].code != index.back().last + 1){
+      Range range = {glyphs[n].code, glyphs[n].code};
+      index.push_back(range);
+      index_glyph.push_back((int)n);
+    }
+    else  index.back().last = glyphs[n].code;
+  }
+
+  std::vector<unsigned char> bitmaps;
+  printf("/* %s: %d characters in %d ranges of %s, %s bitmaps, converted by extras/font_converter */\n\n",
+         name, (int)glyphs.size(), (int)index.size(), argv[arg + 1], mode ? "run-length encoded" : "raw");
+  printf("#include \"epdfont.h\"\n#ifdef AVR_ARCH\n#include <avr/pgmspace.h>\n#else\n#include <pgmspace.h>\n#endif\n\n");
+  printf("const sGlyph %s_Glyphs[] PROGMEM = {\n", name);
+  for(size_t n = 0; n < glyphs.size(); n++){
+    const Glyph& glyph = glyphs[n];
+    int offset = (int)bitmaps.size();
+    if(mode)  encodeRle(glyph, bitmaps);
+    else  encodeRaw(glyph, bitmaps);
+    if(offset > 0xFFFF  ||  glyph.width > 255  ||  glyph.height > 255  ||  glyph.advance < 0  ||  glyph.advance > 255  ||
+       glyph.x_offset < -128  ||  glyph.x_offset > 127  ||  ascent - glyph.y_top > 255){
+      fprintf(stderr, "character %d does not fit the format\n", glyph.code);
+      return 1;
+    }
+    printf("  {%d, %d, %d, %d, %d, %d},  /* U+%04X */\n", offset, glyph.width, glyph.height,
+           glyph.advance, glyph.x_offset, glyph.height ? ascent - glyph.y_top : 0, glyph.code);
+  }
+  printf("};\n\nconst sGlyphRange %s_Ranges[] PROGMEM = {\n", name);
+  for(size_t n = 0; n < index.size(); n++){
+    printf("  {0x%04X, 0x%04X, %d},\n", index[n].first, index[n].last, index_glyph[n]);
+  }
+  printf("};\n\nconst uint8_t %s_Bitmaps[] PROGMEM = {", name);
+  for(size_t n = 0; n < bitmaps.size(); n++)  printf("%s0x%02X,", n % 16 ? " " : "\n  ", bitmaps[n]);
+  printf("\n};\n\n");
+  printf("sPFONT %s = {\n  %s_Bitmaps,\n  %s_Glyphs,\n  %s_Ranges,\n  %d, /* Ranges */\n  %d, /* Height */\n  %d, /* Rle */\n};\n",
+         name, name, name, name, (int)index.size(), ascent + descent, mode);
+  fprintf(stderr, "%s: %d glyphs in %d ranges, %d bytes of bitmaps (raw %d, rle %d), line height %d\n",
+          name, (int)glyphs.size(), (int)index.size(), (int)bitmaps.size(), (int)raw.size(), (int)rle.size(), ascent + descent);
+  return 0;
+}
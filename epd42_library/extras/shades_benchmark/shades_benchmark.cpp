@@ -0,0 +1,167 @@
+/*
+ *  Host benchmark for the gray shade pipeline (no Arduino needed).
+ *  It compares, on a few synthetic images and on any 24-bit BMP given on the command line,
+ *  the refresh passes and the output error of:
+ *  - the fixed 8 level thresholds of drawGrayShades;
+ *  - the histogram-adaptive thresholds (planShades with a max RMS error);
+ *  - error diffusion down to K physical levels (ditherShades), then rendered by the shade pipeline.
+ *
+ *  The rendered tone of a pixel is the nominal tone (shadeTone) of the number of shades it is
+ *  black in. "rms" is the plain per-pixel error, "perceived" the error after a 5x5 box blur of
+ *  both images, standing for the eye integrating the dither pattern at viewing distance.
+ *
+ *  Build and run from this folder:
+ *    g++ -O2 -I../.. shades_benchmark.cpp ../../epdshades.cpp -o shades_benchmark
+ *    ./shades_benchmark ../../Gray_shade_EPD/gradient.bmp
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "epdshades.h"
+
+const int img_width = 400, img_height = 300;
+
+
+// Renders the image the way the panel would show it after the given pass schedule.
+void renderPlan(const uint8_t* img, const ShadePlan& plan, uint8_t* out){
+  for(int i = 0; i < img_width * img_height; i++){
+    uint8_t level = 0;
+    for(uint8_t p = 0; p < plan.passes; p++){
+      if(img[i] < plan.thresh[p])  level += plan.last_shade[p] - plan.first_shade[p] + 1;
+    }
+    out[i] = shadeTone(level);
+  }
+}
+
+void boxBlur(const uint8_t* src, float* dst){
+  for(int y = 0; y < img_height; y++){
+    for(int x = 0; x < img_width; x++){
+      int sum = 0, cnt = 0;
+      for(int dy = -2; dy <= 2; dy++){
+        for(int dx = -2; dx <= 2; dx++){
+          int xx = x + dx, yy = y + dy;
+          if(xx < 0 || xx >= img_width || yy < 0 || yy >= img_height)  continue;
+          sum += src[xx + yy * img_width];
+          cnt++;
+        }
+      }
+      dst[x + y * img_width] = (float)sum / cnt;
+    }
+  }
+}
+
+void report(const char* name, const char* mode, const uint8_t* original, const uint8_t* rendered, uint8_t passes){
+  static float blur_a[img_width * img_height], blur_b[img_width * img_height];
+  double err = 0, perceived = 0;
+  boxBlur(original, blur_a);
+  boxBlur(rendered, blur_b);
+  for(int i = 0; i < img_width * img_height; i++){
+    double d = (double)original[i] - rendered[i];
+    double e = (double)blur_a[i] - blur_b[i];
+    err += d * d;
+    perceived += e * e;
+  }
+  printf("%-12s %-20s passes %d   rms %6.2f   perceived %6.2f\n", name, mode, passes,
+         sqrt(err / (img_width * img_height)), sqrt(perceived / (img_width * img_height)));
+}
+
+void benchmark(const char* name, const uint8_t* img){
+  static uint8_t work[img_width * img_height], rendered[img_width * img_height];
+  ShadeImage image = {img, img_width, img_height, 8, NULL, 0};
+  ShadePlan plan;
+  char mode[32];
+
+  planShades(image, plan);
+  renderPlan(img, plan, rendered);
+  report(name, "fixed thresholds", img, rendered, plan.passes);
+
+  const uint8_t rms_limits[] = {8, 16, 24};
+  for(uint8_t k = 0; k < sizeof(rms_limits); k++){
+    planShades(image, plan, rms_limits[k]);
+    renderPlan(img, plan, rendered);
+    sprintf(mode, "adaptive, rms <= %d", rms_limits[k]);
+    report(name, mode, img, rendered, plan.passes);
+  }
+
+  for(uint8_t levels = 2; levels <= SHADES; levels++){
+    memcpy(work, img, sizeof(work));
+    ditherShades(work, img_width, img_height, levels);
+    ShadeImage dithered = {work, img_width, img_height, 8, NULL, 0};
+    planShades(dithered, plan);
+    renderPlan(work, plan, rendered);
+    sprintf(mode, "dithered, %d levels", levels);
+    report(name, mode, img, rendered, plan.passes);
+  }
+  printf("\n");
+}
+
+
+// 24-bit Windows BMP, cropped or padded (white) to 400x300; see b_BMP.ino in the examples
+bool loadBmp(const char* filename, uint8_t* img){
+  FILE* f = fopen(filename, "rb");
+  if(f == NULL)  return false;
+  uint8_t header[54];
+  if(fread(header, 1, 54, f) != 54  ||  header[0] != 'B'  ||  header[1] != 'M'  ||  header[28] != 24){
+    fclose(f);
+    return false;
+  }
+  uint32_t offset = header[10] | (header[11] << 8) | (header[12] << 16) | ((uint32_t)header[13] << 24);
+  int32_t w = header[18] | (header[19] << 8) | (header[20] << 16) | ((uint32_t)header[21] << 24);
+  int32_t h = header[22] | (header[23] << 8) | (header[24] << 16) | ((uint32_t)header[25] << 24);
+  bool flip = h > 0;
+  if(h < 0)  h = -h;
+  uint32_t row_size = (w * 3 + 3) & ~3;
+  uint8_t* row = (uint8_t*)malloc(row_size);
+
+  memset(img, 255, img_width * img_height);
+  for(int y = 0; y < h  &&  y < img_height; y++){
+    fseek(f, offset + (flip ? (h - 1 - y) : y) * row_size, SEEK_SET);
+    if(fread(row, 1, row_size, f) != row_size)  break;
+    for(int x = 0; x < w  &&  x < img_width; x++){
+      img[x + y * img_width] = (row[3 * x] + row[3 * x + 1] + row[3 * x + 2]) / 3;
+    }
+  }
+  free(row);
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char** argv){
+  static uint8_t img[img_width * img_height];
+
+  for(int y = 0; y < img_height; y++){
+    for(int x = 0; x < img_width; x++){
+      img[x + y * img_width] = (x * 255) / (img_width - 1);
+    }
+  }
+  benchmark("ramp", img);
+
+  for(int y = 0; y < img_height; y++){
+    for(int x = 0; x < img_width; x++){
+      double r = sqrt((double)(x - 200) * (x - 200) + (y - 150) * (y - 150)) / 250.0;
+      img[x + y * img_width] = (uint8_t)(255 * (r > 1 ? 1 : r));
+    }
+  }
+  benchmark("radial", img);
+
+  for(int y = 0; y < img_height; y++){
+    for(int x = 0; x < img_width; x++){
+      double v = 128 + 60 * sin(x / 23.0) * cos(y / 31.0) + 40 * sin((x + 2 * y) / 57.0);
+      img[x + y * img_width] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+  }
+  benchmark("smooth", img);
+
+  for(int k = 1; k < argc; k++){
+    if(loadBmp(argv[k], img)){
+      const char* name = strrchr(argv[k], '/');
+      benchmark(name ? name + 1 : argv[k], img);
+    }
+    else{
+      printf("%s: not a 24-bit BMP\n\n", argv[k]);
+    }
+  }
+  return 0;
+}